@@ -4,38 +4,61 @@
 #include "leds.h"
 #include "net/netstack.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "core/net/linkaddr.h"
+#include "dev/serial-line.h"
 /*---------------------------------------------------------------------------*/
 #include "sched_collect.h"
+#include "payload_codec.h"
+#include "sink_stats.h"
 #include "sys/node-id.h"
 #include "deployment.h"
 #include "simple-energest.h"
 /*---------------------------------------------------------------------------*/
-#ifndef CONTIKI_TARGET_SKY
-linkaddr_t sink = {{0xF7, 0x9C}}; /* Testebed: Firefly node 1 will be sink */
-#else
-linkaddr_t sink = {{0x01, 0x00}}; /* Cooja: Sky node 1 will be our sink */
-#endif
+/* Application packet: SAMPLES_PER_MSG readings packed in a payload_frame */
+#define SAMPLES_PER_MSG 8
+#define SAMPLE_PERIOD (EPOCH_DURATION / SAMPLES_PER_MSG)
+/* CMD_SET_RATE: shorter periods would take more readings in an epoch than
+ * a frame holds */
+#define MIN_SAMPLE_PERIOD (EPOCH_DURATION / PAYLOAD_MAX_SAMPLES)
+/* Alarm: a reading this far from the one of the last alarm is sent right
+ * away as an urgent packet (single sample frame, own seqn) */
+#define ALARM_DELTA 20
+/* CMD_RESEND: the last RESEND_FRAMES frames sent, encoded, slot seqn % N */
+#define RESEND_FRAMES 4
 /*---------------------------------------------------------------------------*/
-/* Application packet */
-typedef struct {
+static clock_time_t sample_period = SAMPLE_PERIOD; /* CMD_SET_RATE */
+static bool resend = false;                         /* CMD_RESEND */
+static uint16_t resend_seqn;
+static struct sent_frame {
   uint16_t seqn;
-}
-__attribute__((packed))
-test_msg_t;
+  uint8_t len;                                      /* zero: empty slot */
+  uint8_t buf[PAYLOAD_MAX_LEN];
+} sent_frames[RESEND_FRAMES];
+static int16_t alarm_ref;                           /* reading of the last alarm */
 /*---------------------------------------------------------------------------*/
 PROCESS(app_process, "App process");
 AUTOSTART_PROCESSES(&app_process);
 /*---------------------------------------------------------------------------*/
 static struct sched_collect_conn sched_collect;
 static void recv_cb(const linkaddr_t *originator, uint8_t hops);
-struct sched_collect_callbacks cb = {.recv = recv_cb};
+static void cmd_cb(const struct sched_collect_cmd *cmd);
+static void parse_command(const char *line);
+static int16_t read_sensor(void);
+static void send_alarm(int16_t value);
+static struct sent_frame *find_frame(uint16_t seqn);
+struct sched_collect_callbacks cb = {.recv = recv_cb, .cmd = cmd_cb};
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(app_process, ev, data)
 {
   static struct etimer et;
-  static test_msg_t msg = {.seqn=0};
+  static struct etimer sample_et;
+  static struct payload_frame frame;
+  static uint16_t seqn = 0;
   static int ret = 0;
+  struct sent_frame *sent;
+  int16_t value;
 
   PROCESS_BEGIN();
   printf("CLOCK_SECOND: %lu\n", CLOCK_SECOND);
@@ -46,31 +69,72 @@ PROCESS_THREAD(app_process, ev, data)
   /* Start energest to estimate node duty cycle */
   simple_energest_start();
 
-  if(linkaddr_cmp(&sink, &linkaddr_node_addr)) {
+  /* Sinks: SCHED_COLLECT_SINKS, Firefly node 1 on the testbed, Sky node 1 in Cooja */
+  if(sched_collect_sink_rank(&linkaddr_node_addr) >= 0) {
     printf("App: I am sink %02x:%02x with node_id %u\n",
       linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], node_id);
     etimer_set(&et, CLOCK_SECOND * 2);
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
     sched_collect_open(&sched_collect, COLLECT_CHANNEL, true, &cb);
+    sink_stats_init(&sched_collect);
+
+    /* Downlink commands from the serial line: cmd <xx:yy|*> <type> <arg> */
+    while(1) {
+      PROCESS_WAIT_EVENT_UNTIL(ev == serial_line_event_message);
+      parse_command((char *)data);
+    }
   }
   else {
     printf("App: I am normal node %02x:%02x with node_id %u\n",
       linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1], node_id);
-    sched_collect_open(&sched_collect, COLLECT_CHANNEL, false, NULL);
+    sched_collect_open(&sched_collect, COLLECT_CHANNEL, false, &cb);
 
+    payload_frame_init(&frame, seqn);
+    alarm_ref = read_sensor();
     etimer_set(&et, EPOCH_DURATION);
+    etimer_set(&sample_et, sample_period);
     while(1) {
-      /* Set data packet to be sent in the data collection time window */
-      ret = sched_collect_send(&sched_collect, (uint8_t *) &msg, sizeof(msg));
-      if (ret != 0)
-        printf("App: Send seqn %d\n", msg.seqn);
-      else
-        printf("App: packet with seqn %d could not be scheduled.\n",
-          msg.seqn);
-      msg.seqn++;
-      /* Reset timer */
-      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
-      etimer_reset(&et);
+      sent = resend ? find_frame(resend_seqn) : NULL;
+      if (resend && sent == NULL)
+        printf("App: cannot resend seqn %d\n", resend_seqn);
+      if (sent != NULL) {
+        /* Send the old frame again, keep sampling into the current one
+         * until the next epoch */
+        ret = sched_collect_send(&sched_collect, sent->buf, sent->len, SCHED_COLLECT_PRIO_NORMAL);
+        printf("App: Resend seqn %d %s\n", resend_seqn, ret ? "ok" : "failed");
+      }
+      else {
+        /* Set data packet to be sent in the data collection time window */
+        sent = &sent_frames[seqn % RESEND_FRAMES];
+        sent->seqn = seqn;
+        sent->len = payload_encode(&frame, sent->buf, sizeof(sent->buf));
+        ret = sched_collect_send(&sched_collect, sent->buf, sent->len, SCHED_COLLECT_PRIO_NORMAL);
+        if (ret != 0)
+          printf("App: Send seqn %d samples %d len %d\n", seqn, frame.count, sent->len);
+        else
+          printf("App: packet with seqn %d could not be scheduled.\n",
+            seqn);
+        seqn++;
+        payload_frame_init(&frame, seqn);
+      }
+      resend = false;
+
+      /* Sample the sensor until the next epoch */
+      while(1) {
+        PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_TIMER);
+        if(etimer_expired(&sample_et)) {
+          etimer_set(&sample_et, sample_period);
+          value = read_sensor();
+          if(!payload_frame_add(&frame, value))
+            printf("App: frame seqn %d full, reading dropped\n", seqn);
+          if(abs(value - alarm_ref) >= ALARM_DELTA)
+            send_alarm(value);
+        }
+        if(etimer_expired(&et)) {
+          etimer_reset(&et);
+          break;
+        }
+      }
     }
   }
   PROCESS_END();
@@ -79,13 +143,120 @@ PROCESS_THREAD(app_process, ev, data)
 static void
 recv_cb(const linkaddr_t *originator, uint8_t hops)
 {
-  test_msg_t msg;
-  if (packetbuf_datalen() != sizeof(msg)) {
-    printf("App: wrong length: %d\n", packetbuf_datalen());
+  static struct payload_frame frame;
+  uint8_t i;
+
+  if (!payload_decode(packetbuf_dataptr(), packetbuf_datalen(), &frame)) {
+    printf("App: wrong payload: %d\n", packetbuf_datalen());
+    return;
+  }
+  if(sched_collect.rx_prio == SCHED_COLLECT_PRIO_URGENT) {
+    printf("App: Alarm from %02x:%02x seqn %d value %d hops %d\n",
+      originator->u8[0], originator->u8[1], frame.seqn, frame.samples[0], hops);
     return;
   }
-  memcpy(&msg, packetbuf_dataptr(), sizeof(msg));
   printf("App: Recv from %02x:%02x seqn %d hops %d\n",
-    originator->u8[0], originator->u8[1], msg.seqn, hops);
+    originator->u8[0], originator->u8[1], frame.seqn, hops);
+  sink_stats_update(originator, frame.seqn, hops);
+
+  /* Raw frame, decoded offline by parse-stats.py */
+  printf("App: Samples from %02x:%02x seqn %d data ",
+    originator->u8[0], originator->u8[1], frame.seqn);
+  for (i = 0; i < packetbuf_datalen(); i++)
+    printf("%02x", ((uint8_t *)packetbuf_dataptr())[i]);
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+cmd_cb(const struct sched_collect_cmd *cmd)
+{
+  switch(cmd->type) {
+  case CMD_ACTUATE:
+    printf("App: Actuate %u\n", cmd->arg);
+    if(cmd->arg)
+      leds_on(LEDS_ALL);
+    else
+      leds_off(LEDS_ALL);
+    break;
+  case CMD_SET_RATE:
+    if((uint32_t)cmd->arg * CLOCK_SECOND <= MIN_SAMPLE_PERIOD) {
+      printf("App: Sample period %u s rejected, must be above %u ms\n",
+        cmd->arg, (unsigned)(MIN_SAMPLE_PERIOD * 1000UL / CLOCK_SECOND));
+      break;
+    }
+    sample_period = cmd->arg * CLOCK_SECOND;
+    printf("App: Sample period %u s\n", cmd->arg);
+    break;
+  case CMD_RESEND:
+    resend = true;
+    resend_seqn = cmd->arg;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_command(const char *line)
+{
+  linkaddr_t dest;
+  char *p;
+  long type, arg;
+
+  if(strncmp(line, "cmd ", 4) != 0)
+    return;
+  line += 4;
+
+  linkaddr_copy(&dest, &linkaddr_null);
+  if(*line == '*') {
+    p = (char *)line + 1;
+  } else {
+    dest.u8[0] = strtol(line, &p, 16);
+    if(*p != ':') {
+      printf("App: usage: cmd <xx:yy|*> <type> <arg>\n");
+      return;
+    }
+    dest.u8[1] = strtol(p + 1, &p, 16);
+  }
+  type = strtol(p, &p, 10);
+  arg = strtol(p, &p, 10);
+
+  if(!sched_collect_command(&sched_collect, &dest, type, arg))
+    printf("App: command queue full\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_alarm(int16_t value)
+{
+  static struct payload_frame alarm;
+  static uint16_t alarm_seqn = 0;
+  uint8_t buf[PAYLOAD_MAX_LEN];
+  uint8_t len;
+
+  payload_frame_init(&alarm, alarm_seqn);
+  payload_frame_add(&alarm, value);
+  len = payload_encode(&alarm, buf, sizeof(buf));
+  if(sched_collect_send(&sched_collect, buf, len, SCHED_COLLECT_PRIO_URGENT))
+    printf("App: Alarm seqn %d value %d\n", alarm_seqn, value);
+  else
+    printf("App: alarm with seqn %d could not be scheduled.\n", alarm_seqn);
+  alarm_seqn++;
+  alarm_ref = value;
+}
+/*---------------------------------------------------------------------------*/
+/* CMD_RESEND: the frame of seqn if still among the last RESEND_FRAMES */
+static struct sent_frame *
+find_frame(uint16_t seqn)
+{
+  struct sent_frame *sent = &sent_frames[seqn % RESEND_FRAMES];
+
+  return sent->len && sent->seqn == seqn ? sent : NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Synthetic slowly varying reading (random walk), stands in for a sensor */
+static int16_t
+read_sensor(void)
+{
+  static int16_t value = 2000;
+  value += (int16_t)(random_rand() % 5) - 2;
+  return value;
 }
 /*---------------------------------------------------------------------------*/
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+from __future__ import division
+
+import re
+import sys
+import math
+import os.path
+import argparse
+
+sink_id = 1
+
+# Cooja DGRM edge, mote indices are 0-based in the order of the <mote> list
+dgrm_edge = """    <edge>
+      <source>{src}</source>
+      <dest>
+        org.contikios.cooja.radiomediums.DGRMDestinationRadio
+        <radio>{dst}</radio>
+        <ratio>{prr:.3f}</ratio>
+        <signal>{rssi:.1f}</signal>
+        <lqi>105</lqi>
+        <delay>0</delay>
+        <channel>-1</channel>
+      </dest>
+    </edge>
+"""
+
+cooja_mote = """    <mote>
+      <breakpoints />
+      <interface_config>
+        org.contikios.cooja.interfaces.Position
+        <x>{x:.1f}</x>
+        <y>{y:.1f}</y>
+        <z>0.0</z>
+      </interface_config>
+      <interface_config>
+        org.contikios.cooja.mspmote.interfaces.MspClock
+        <deviation>1.0</deviation>
+      </interface_config>
+      <interface_config>
+        org.contikios.cooja.mspmote.interfaces.MspMoteID
+        <id>{id}</id>
+      </interface_config>
+      <motetype_identifier>{motetype}</motetype_identifier>
+    </mote>
+"""
+
+
+def parse_file(log_file, testbed=False):
+	# Print some basic information for the user
+	print(f"Logfile: {log_file}")
+	print(f"{'Cooja simulation' if not testbed else 'Testbed experiment'}")
+
+	if testbed:
+		# Regex for testbed experiments
+		testbed_record_pattern = r"\[(?P<time>.{23})\] INFO:firefly\.(?P<self_id>\d+): \d+\.firefly < b"
+		regex_node = re.compile(r"{}'Rime configured with address "
+			r"(?P<src1>\w+):(?P<src2>\w+)'".format(testbed_record_pattern))
+		regex_beacon = re.compile(r"{}'collect: recv beacon from (?P<src1>\w+):(?P<src2>\w+), "
+			r"seqn (?P<seqn>\d+), metric \d+, rssi (?P<rssi>-?\d+)".format(testbed_record_pattern))
+		regex_sent = re.compile(r"{}'collect: sending beacon: seqn (?P<seqn>\d+)".format(
+			testbed_record_pattern))
+	else:
+		# Regular expressions for COOJA
+		record_pattern = r"(?P<time>[\w:.]+)\s+ID:(?P<self_id>\d+)\s+"
+		regex_node = re.compile(r"{}Rime started with address "
+			r"(?P<src1>\d+).(?P<src2>\d+)".format(record_pattern))
+		regex_beacon = re.compile(r"{}collect: recv beacon from (?P<src1>\w+):(?P<src2>\w+), "
+			r"seqn (?P<seqn>\d+), metric \d+, rssi (?P<rssi>-?\d+)".format(record_pattern))
+		regex_sent = re.compile(r"{}collect: sending beacon: seqn (?P<seqn>\d+)".format(
+			record_pattern))
+
+	# Link address of each node id, as printed by the receivers
+	addr_map = {}
+	# Beacon seqns transmitted by each node
+	dsent = {}
+	# Beacon seqns each node was listening in (it heard at least one beacon)
+	dawake = {}
+	# Beacons heard per link: (src addr, dst id) -> {seqn: [rssi, ...]}
+	dlinks = {}
+
+	with open(log_file, 'r') as f:
+		for line in f:
+
+			# Node address
+			m = regex_node.match(line)
+			if m:
+				d = m.groupdict()
+				if testbed:
+					addr = "{}:{}".format(d["src1"], d["src2"])
+				else:
+					addr = "{:02x}:{:02x}".format(int(d["src1"]), int(d["src2"]))
+				addr_map[addr] = int(d["self_id"])
+				continue
+
+			# Beacon received
+			m = regex_beacon.match(line)
+			if m:
+				d = m.groupdict()
+				dst = int(d["self_id"])
+				src = "{}:{}".format(d["src1"], d["src2"])
+				seqn = int(d["seqn"])
+				dawake.setdefault(dst, set()).add(seqn)
+				dlinks.setdefault((src, dst), {}).setdefault(seqn, []).append(int(d["rssi"]))
+				continue
+
+			# Beacon sent
+			m = regex_sent.match(line)
+			if m:
+				d = m.groupdict()
+				src = int(d["self_id"])
+				seqn = int(d["seqn"])
+				dsent.setdefault(src, {}).setdefault(seqn, 0)
+				dsent[src][seqn] += 1
+
+	# PRR of a link: beacons heard over the beacons its source sent in the
+	# epochs the receiver was awake, so that the epochs a node spent out of
+	# sync are not counted as losses.
+	links = []
+	unknown = set()
+	for (addr, dst), heard in dlinks.items():
+		if addr not in addr_map:
+			unknown.add(addr)
+			continue
+		src = addr_map[addr]
+		sent = sum(n for seqn, n in dsent.get(src, {}).items() if seqn in dawake[dst])
+		rx = sum(len(r) for r in heard.values())
+		rssi = [r for lst in heard.values() for r in lst]
+		mean = sum(rssi) / len(rssi)
+		std = math.sqrt(sum((r - mean) ** 2 for r in rssi) / len(rssi))
+		links.append((src, dst, min(1.0, rx / sent) if sent else 1.0, mean, std, rx, sent))
+
+	if unknown:
+		print("----- WARNING -----")
+		for addr in sorted(unknown):
+			print("Warning: address {} does not belong to any logged node.".format(addr))
+		print("")
+
+	links.sort()
+	return links
+
+
+def write_trace(links, log_file, trace_file):
+	with open(trace_file, 'w') as f:
+		f.write("# Link trace of {}\n".format(os.path.basename(log_file)))
+		f.write("# src\tdst\tprr\trssi\tstd\t# heard/sent\n")
+		for src, dst, prr, rssi, std, rx, sent in links:
+			f.write("{}\t{}\t{:.3f}\t{:.0f}\t{:.1f}\t# {}/{}\n".format(
+				src, dst, prr, rssi, std, rx, sent))
+	print("Saving link trace in: {}".format(trace_file))
+
+
+def write_csc(links, template, csc_file):
+	# Replace the radio medium of a Cooja simulation with a Directed Graph
+	# Radio Medium built from the trace, and the motes with one per node id
+	with open(template, 'r') as f:
+		csc = f.read()
+
+	nodes = sorted(set([l[0] for l in links] + [l[1] for l in links] + [sink_id]))
+	index = {node: i for i, node in enumerate(nodes)}
+	motetype = re.search(r"<motetype_identifier>(\w+)</motetype_identifier>", csc).group(1)
+
+	medium = "<radiomedium>\n      org.contikios.cooja.radiomediums.DirectedGraphMedium\n"
+	for src, dst, prr, rssi, std, rx, sent in links:
+		medium += dgrm_edge.format(src=index[src], dst=index[dst], prr=prr, rssi=rssi)
+	medium += "    </radiomedium>"
+	csc = re.sub(r"<radiomedium>[\s\S]*?</radiomedium>", lambda m: medium, csc, count=1)
+
+	# Positions do not matter to DGRM, put the motes on a grid for the GUI
+	side = int(math.ceil(math.sqrt(len(nodes))))
+	motes = "".join(cooja_mote.format(x=20.0 * (i % side), y=20.0 * (i // side),
+		id=node, motetype=motetype) for i, node in enumerate(nodes))
+	csc = re.sub(r"\s*<mote>\s*<breakpoints[\s\S]*?</mote>\n", "\n", csc)
+	csc = csc.replace("    </motetype>\n", "    </motetype>\n" + motes, 1)
+	# Plugins referring to mote indices of the template
+	csc = re.sub(r"\s*<mote>\d+</mote>", "", csc)
+
+	with open(csc_file, 'w') as f:
+		f.write(csc)
+	print("Saving Cooja simulation in: {}".format(csc_file))
+
+
+def parse_args():
+	parser = argparse.ArgumentParser(
+		description="Extract per-link PRR and RSSI from the beacon logs into "
+		"a link trace for the simulator (sim/) or Cooja.")
+	parser.add_argument('logfile', action="store", type=str,
+		help="data collection logfile to be parsed.")
+	parser.add_argument('-t', '--testbed', action='store_true',
+		help="flag for testbed experiments")
+	parser.add_argument('-o', '--output', type=str,
+		help="trace file (default: <logfile>-links.txt)")
+	parser.add_argument('--min-sent', type=int, default=5,
+		help="drop links with fewer beacon opportunities (default: 5)")
+	parser.add_argument('--csc', type=str,
+		help="also write a Cooja simulation using this .csc as template")
+	return parser.parse_args()
+
+
+if __name__ == '__main__':
+	args = parse_args()
+
+	if not os.path.isfile(args.logfile):
+		print("The logfile argument {} is not a file.".format(args.logfile))
+		sys.exit(1)
+
+	links = parse_file(args.logfile, testbed=args.testbed)
+	links = [l for l in links if l[6] >= args.min_sent]
+
+	nodes = set([l[0] for l in links] + [l[1] for l in links])
+	print("Nodes: {} Links: {}".format(len(nodes), len(links)))
+	if links:
+		print("Average PRR: {:.3f} Average RSSI: {:.1f} dBm".format(
+			sum(l[2] for l in links) / len(links), sum(l[3] for l in links) / len(links)))
+
+	fname_common = os.path.splitext(args.logfile)[0]
+	write_trace(links, args.logfile, args.output or "{}-links.txt".format(fname_common))
+	if args.csc:
+		write_csc(links, args.csc, "{}-dgrm.csc".format(fname_common))
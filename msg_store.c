@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "msg_store.h"
+#if SCHED_COLLECT_CONF_STORE
+/*---------------------------------------------------------------------------*/
+#define SEG_HDR_LEN 1      // generation byte
+#define RECORD_OVERHEAD 2  // len and mark
+#define GEN_DIFF(a, b) ((int8_t)((uint8_t)(a) - (uint8_t)(b)))
+/*---------------------------------------------------------------------------*/
+struct segment
+{
+  bool used;
+  uint8_t gen;      // tells the oldest segment after a reboot
+  uint16_t records; // records not yet consumed
+};
+static struct segment seg[MSG_STORE_SEGMENTS];
+typedef char msg_store_ram_underestimated[sizeof(seg) <= MSG_STORE_RAM ? 1 : -1];
+static uint8_t nseg;             // segments in use, from rd_seg to wr_seg
+static uint8_t rd_seg, wr_seg;
+static uint16_t rd_off, wr_off;  // next record to read / to write
+static uint8_t gen_next;
+static uint16_t total;
+/* End of the last batch, consumed by msg_store_commit() */
+static uint8_t batch_seg;
+static uint16_t batch_off;
+static uint8_t batch_count;
+/*---------------------------------------------------------------------------*/
+static const char *seg_name(uint8_t i)
+{
+  static char name[] = "store00";
+
+  name[5] = '0' + i / 10;
+  name[6] = '0' + i % 10;
+  return name;
+}
+/*---------------------------------------------------------------------------*/
+/* Read the length of the record at off and, if it fits in max bytes, its
+ * data into buf. Returns 0 at the end of the segment or on a torn record. */
+static uint8_t read_record(int fd, uint16_t off, uint8_t *buf, uint8_t max)
+{
+  uint8_t len, mark;
+
+  if (cfs_seek(fd, off, CFS_SEEK_SET) != off || cfs_read(fd, &len, 1) != 1 || len == 0)
+    return 0;
+  if (buf == NULL || len > max)
+    cfs_seek(fd, off + 1 + len, CFS_SEEK_SET);
+  else if (cfs_read(fd, buf, len) != len)
+    return 0;
+  if (cfs_read(fd, &mark, 1) != 1 || mark != MSG_STORE_MARK)
+    return 0;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void remove_segment(uint8_t i)
+{
+  cfs_remove(seg_name(i));
+  total -= seg[i].records;
+  seg[i].used = false;
+  seg[i].records = 0;
+  if (--nseg > 0)
+  {
+    rd_seg = (i + 1) % MSG_STORE_SEGMENTS;
+    rd_off = SEG_HDR_LEN;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Open the next segment of the ring for writing, dropping the oldest one
+ * if the ring is full */
+static int new_segment(void)
+{
+  uint8_t next = nseg == 0 ? wr_seg : (wr_seg + 1) % MSG_STORE_SEGMENTS;
+  int fd, ok;
+
+  if (nseg == MSG_STORE_SEGMENTS)
+  {
+    printf("Store: full, dropping %u msgs\n", seg[rd_seg].records);
+    remove_segment(rd_seg);
+    batch_count = 0; // the pending batch may refer to it
+  }
+
+  /* Reserve the whole segment so that Coffee never has to move it */
+  cfs_remove(seg_name(next));
+  if (cfs_coffee_reserve(seg_name(next), MSG_STORE_SEG_SIZE) < 0)
+    return 0;
+  fd = cfs_open(seg_name(next), CFS_WRITE | CFS_APPEND);
+  if (fd < 0)
+    return 0;
+  ok = cfs_write(fd, &gen_next, SEG_HDR_LEN) == SEG_HDR_LEN;
+  cfs_close(fd);
+  if (!ok)
+    return 0;
+
+  seg[next].used = true;
+  seg[next].gen = gen_next++;
+  seg[next].records = 0;
+  if (nseg++ == 0)
+  {
+    rd_seg = next;
+    rd_off = SEG_HDR_LEN;
+  }
+  wr_seg = next;
+  wr_off = SEG_HDR_LEN;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void msg_store_init(void)
+{
+  uint8_t i, gen, len;
+  uint16_t off;
+  int fd;
+  bool any = false;
+
+  nseg = 0;
+  total = 0;
+  batch_count = 0;
+  gen_next = 0;
+  rd_seg = wr_seg = 0;
+
+  for (i = 0; i < MSG_STORE_SEGMENTS; i++)
+  {
+    seg[i].used = false;
+    seg[i].records = 0;
+    fd = cfs_open(seg_name(i), CFS_READ);
+    if (fd < 0)
+      continue;
+    if (cfs_read(fd, &gen, SEG_HDR_LEN) != SEG_HDR_LEN)
+    {
+      cfs_close(fd);
+      cfs_remove(seg_name(i)); // empty leftover
+      continue;
+    }
+    for (off = SEG_HDR_LEN; (len = read_record(fd, off, NULL, 0)) != 0; off += len + RECORD_OVERHEAD)
+      seg[i].records++;
+    cfs_close(fd);
+
+    seg[i].used = true;
+    seg[i].gen = gen;
+    total += seg[i].records;
+    nseg++;
+    /* The ring is contiguous: oldest and newest by generation */
+    if (!any || GEN_DIFF(gen, seg[wr_seg].gen) > 0)
+      wr_seg = i;
+    if (!any || GEN_DIFF(gen, seg[rd_seg].gen) < 0)
+      rd_seg = i;
+    any = true;
+  }
+
+  rd_off = SEG_HDR_LEN;
+  if (any)
+    gen_next = seg[wr_seg].gen + 1;
+  /* Never append to a segment of the previous boot, it may end with a
+   * torn record: the next message opens a new segment */
+  wr_off = MSG_STORE_SEG_SIZE;
+  if (total > 0)
+    printf("Store: recovered %u msgs in %u segments\n", total, nseg);
+}
+/*---------------------------------------------------------------------------*/
+int msg_store_put(const uint8_t *data, uint8_t len)
+{
+  uint8_t mark = MSG_STORE_MARK;
+  int fd, ok;
+
+  if (len == 0 || SEG_HDR_LEN + len + RECORD_OVERHEAD > MSG_STORE_SEG_SIZE)
+    return 0;
+  if ((nseg == 0 || wr_off + len + RECORD_OVERHEAD > MSG_STORE_SEG_SIZE) && !new_segment())
+    return 0;
+
+  fd = cfs_open(seg_name(wr_seg), CFS_WRITE | CFS_APPEND);
+  if (fd < 0)
+    return 0;
+  ok = cfs_write(fd, &len, 1) == 1 && cfs_write(fd, data, len) == len &&
+       cfs_write(fd, &mark, 1) == 1;
+  cfs_close(fd);
+  if (!ok)
+  {
+    wr_off = MSG_STORE_SEG_SIZE; // continue in a new segment
+    return 0;
+  }
+
+  wr_off += len + RECORD_OVERHEAD;
+  seg[wr_seg].records++;
+  total++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t msg_store_batch(uint8_t *buf, uint8_t len, uint8_t *count)
+{
+  uint8_t s = rd_seg, n, pos = 0;
+  uint16_t off = rd_off;
+  int fd = -1;
+
+  *count = 0;
+  while (*count < total && pos + 1 < len)
+  {
+    if (fd < 0 && (fd = cfs_open(seg_name(s), CFS_READ)) < 0)
+      break;
+    n = read_record(fd, off, buf + pos + 1, len - pos - 1);
+    if (n == 0) // end of the segment
+    {
+      cfs_close(fd);
+      fd = -1;
+      if (s == wr_seg)
+        break;
+      s = (s + 1) % MSG_STORE_SEGMENTS;
+      off = SEG_HDR_LEN;
+      continue;
+    }
+    if (pos + 1 + n > len)
+      break;
+    buf[pos] = n;
+    pos += n + 1;
+    off += n + RECORD_OVERHEAD;
+    (*count)++;
+  }
+  if (fd >= 0)
+    cfs_close(fd);
+
+  batch_seg = s;
+  batch_off = off;
+  batch_count = *count;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+void msg_store_commit(void)
+{
+  if (batch_count == 0)
+    return;
+
+  /* Segments drained by the batch */
+  while (rd_seg != batch_seg)
+  {
+    batch_count -= seg[rd_seg].records;
+    remove_segment(rd_seg);
+  }
+
+  seg[rd_seg].records -= batch_count;
+  total -= batch_count;
+  rd_off = batch_off;
+  batch_count = 0;
+  if (seg[rd_seg].records == 0)
+  {
+    if (rd_seg == wr_seg)
+      wr_off = MSG_STORE_SEG_SIZE;
+    remove_segment(rd_seg);
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint16_t msg_store_count(void)
+{
+  return total;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* SCHED_COLLECT_CONF_STORE */
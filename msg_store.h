@@ -0,0 +1,55 @@
+#ifndef MSG_STORE_H
+#define MSG_STORE_H
+/*---------------------------------------------------------------------------*/
+#include <stdint.h>
+/*---------------------------------------------------------------------------*/
+/* Persistent FIFO of collect messages on Coffee, used to hold the data of
+ * a node while it has no route to the sink.
+ *
+ * The queue is a log of MSG_STORE_SEGMENTS files of MSG_STORE_SEG_SIZE
+ * bytes, used as a ring. Records are only appended to the newest segment
+ * and a segment is removed as a whole once it has been drained, so every
+ * flash page is written once and erased once per lap (no in-place updates,
+ * which Coffee would turn into micro-log writes). When the ring is full
+ * the oldest segment is dropped.
+ *
+ * Segment: generation (1 byte) | records
+ * Record:  len (1 byte) | data | MSG_STORE_MARK
+ * The trailing mark keeps the last byte of a file non-zero, which Coffee
+ * needs to find the end of the file again after a reboot, and tells a
+ * complete record from one torn by a power failure. */
+#ifdef MSG_STORE_CONF_SEGMENTS
+#define MSG_STORE_SEGMENTS MSG_STORE_CONF_SEGMENTS
+#else
+#define MSG_STORE_SEGMENTS 16
+#endif
+#ifdef MSG_STORE_CONF_SEG_SIZE
+#define MSG_STORE_SEG_SIZE MSG_STORE_CONF_SEG_SIZE
+#else
+#define MSG_STORE_SEG_SIZE 1024
+#endif
+#define MSG_STORE_MARK 0xA5
+#define MSG_STORE_RAM (MSG_STORE_SEGMENTS * 4) // segment table of msg_store.c
+/*---------------------------------------------------------------------------*/
+/* Recover the queue left in flash by the previous boot. Records of a
+ * partially drained segment are delivered again (at least once). */
+void msg_store_init(void);
+/*---------------------------------------------------------------------------*/
+/* Append a message (1 to 255 bytes).
+ * Returns zero on flash errors, non-zero otherwise. */
+int msg_store_put(const uint8_t *data, uint8_t len);
+/*---------------------------------------------------------------------------*/
+/* Copy the oldest messages into buf as a sequence of len | data, as many
+ * as fit in len bytes, without removing them from the queue.
+ * Returns the number of bytes written and sets *count to the number of
+ * messages. A new call starts again from the oldest message. */
+uint8_t msg_store_batch(uint8_t *buf, uint8_t len, uint8_t *count);
+/*---------------------------------------------------------------------------*/
+/* Remove the messages returned by the last msg_store_batch(), e.g. once
+ * their packet has been acknowledged */
+void msg_store_commit(void);
+/*---------------------------------------------------------------------------*/
+/* Number of messages in the queue */
+uint16_t msg_store_count(void);
+/*---------------------------------------------------------------------------*/
+#endif //MSG_STORE_H
@@ -1,30 +1,79 @@
 #!/usr/bin/env python2.7
 from __future__ import division
 
+import io
 import re
 import sys
 import os.path
 import argparse
+import subprocess
+import multiprocessing
 import numpy as np
 import pandas as pd
 from datetime import datetime
+from functools import lru_cache
 
 sink_id = 1
 
-# Firefly addresses
-addr_id_map = {
-	"f7:9c":  1, "d9:76":  2, "f3:84":  3, "f3:ee":  4, "f7:92":  5,
-	"f3:9a":  6, "de:21":  7, "f2:a1":  8, "d8:b5":  9, "f2:1e": 10,
-	"d9:5f": 11, "f2:33": 12, "de:0c": 13, "f2:0e": 14, "d9:49": 15,
-	"f3:dc": 16, "d9:23": 17, "f3:8b": 18, "f3:c2": 19, "f3:b7": 20,
-	"de:e4": 21, "f3:88": 22, "f7:9a": 23, "f7:e7": 24, "f2:85": 25,
-	"f2:27": 26, "f2:64": 27, "f3:d3": 28, "f3:8d": 29, "f7:e1": 30,
-	"de:af": 31, "f2:91": 32, "f2:d7": 33, "f3:a3": 34, "f2:d9": 35,
-	"d9:9f": 36, "f3:90": 50, "f2:3d": 51, "f7:ab": 52, "f7:c9": 53,
-	"f2:6c": 54, "f2:fc": 56, "f1:f6": 57, "f3:cf": 62, "f3:c3": 63,
-	"f7:d6": 64, "f7:b6": 65, "f7:b7": 70, "f3:f3": 71, "f1:f3": 72,
-	"f2:48": 73, "f3:db": 74, "f3:fa": 75, "f3:83": 76, "f2:b4": 77
-}
+# Firefly addresses, from the deployment description shared with the firmware
+deployment_file = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+	"tools", "deployment.csv")
+
+
+def load_addr_id_map(fname):
+	addr_id_map = {}
+	with open(fname, 'r') as f:
+		for line in f:
+			line = line.split('#', 1)[0].strip()
+			if line and line != "id,addr":
+				node_id, addr = line.split(',')
+				addr_id_map[addr.strip().lower()] = int(node_id)
+	return addr_id_map
+
+
+addr_id_map = load_addr_id_map(deployment_file)
+
+# Testbed jobs (job_<id>/test.log), see testbed/get-test.sh
+jobs_dir = os.path.join(os.path.dirname(os.path.abspath(__file__)), "testbed")
+
+
+@lru_cache(maxsize=1024)
+def second_timestamp(prefix):
+	return datetime.strptime(prefix, '%Y-%m-%d %H:%M:%S').timestamp()
+
+
+def testbed_timestamp(time):
+	# '2021-05-04 10:12:33,123': a single strptime per second of log,
+	# the lines of the same second only differ by the milliseconds
+	return second_timestamp(time[:19]) + int(time[20:23]) / 1000
+
+
+def decode_samples(hexdata):
+	# Mirror of payload_decode() in payload_codec.c:
+	# seqn (LE16) | count | zigzag varint first sample | zigzag varint deltas
+	buf = bytes.fromhex(hexdata)
+	if len(buf) < 3:
+		raise ValueError("payload too short")
+	seqn = buf[0] | (buf[1] << 8)
+	count = buf[2]
+	samples = []
+	pos, prev = 3, 0
+	for _ in range(count):
+		value, shift = 0, 0
+		while True:
+			if pos >= len(buf) or shift >= 16:
+				raise ValueError("truncated varint")
+			value |= (buf[pos] & 0x7F) << shift
+			pos += 1
+			shift += 7
+			if not buf[pos - 1] & 0x80:
+				break
+		delta = (value >> 1) ^ -(value & 1)
+		prev = ((prev + delta + 0x8000) & 0xFFFF) - 0x8000 # int16 wrap
+		samples.append(prev)
+	if pos != len(buf):
+		raise ValueError("trailing bytes")
+	return seqn, samples
 
 
 def compute_node_pdr(fsent, frecv):
@@ -33,11 +82,12 @@ def compute_node_pdr(fsent, frecv):
 	rdf = pd.read_csv(frecv, sep='\t')
 
 	# Remove duplicates if any
-	sdf.drop_duplicates(['src', 'dest', 'seqn'], keep='first', inplace=True)
-	rdf.drop_duplicates(['src', 'dest', 'seqn'], keep='first', inplace=True)
+	# (a packet counts once whichever sink received it)
+	sdf.drop_duplicates(['src', 'seqn'], keep='first', inplace=True)
+	rdf.drop_duplicates(['src', 'seqn'], keep='first', inplace=True)
 
 	# Merge the dataframes
-	mdf = pd.merge(sdf, rdf, on=['src', 'dest', 'seqn'], how='left')
+	mdf = pd.merge(sdf, rdf.drop(columns='dest'), on=['src', 'seqn'], how='left')
 
 	# Discard first and last sequence number:
 	# The first packet may not be sent as nodes boot at different times.
@@ -84,9 +134,10 @@ def compute_node_pdr(fsent, frecv):
 	print("Saving PDR CSV file in: {}".format(fpdr_name))
 	df.to_csv(fpdr_name, sep='\t', index=False,
 		float_format='%.3f', na_rep='nan')
+	return len(nodes), int(df.sent.sum()), int(df.recv.sum())
 
 
-def compute_node_duty_cycle(fenergest):
+def compute_node_duty_cycle(fenergest, sinks):
 	# Read CSV file with dataframe
 	df = pd.read_csv(fenergest, sep='\t')
 
@@ -106,7 +157,7 @@ def compute_node_duty_cycle(fenergest):
 		total_radio = np.sum(rdf.tx + rdf.rx)
 		dc = 100 * total_radio / total_time
 		print("Node: {} Duty Cycle: {:.3f}%".format(node, dc))
-		if node > 1:
+		if node not in sinks:
 			dc_lst.append(dc)
 			# Store the results in the DF
 			idf = len(resdf.index)
@@ -125,6 +176,7 @@ def compute_node_duty_cycle(fenergest):
 	print("Saving Duty Cycle CSV file in: {}".format(fdc_name))
 	resdf.to_csv(fdc_name, sep='\t', index=False, 
 		float_format='%.3f', na_rep='nan')
+	return np.mean(dc_lst), np.amax(dc_lst)
 
 
 def parse_file(log_file, testbed=False):
@@ -138,14 +190,17 @@ def parse_file(log_file, testbed=False):
 	frecv_name = os.path.join(fpath, f"{fname_common}-recv.csv")
 	fsent_name = os.path.join(fpath, f"{fname_common}-sent.csv")
 	fenergest_name = os.path.join(fpath, f"{fname_common}-energest.csv")
+	fsamples_name = os.path.join(fpath, f"{fname_common}-samples.csv")
 	frecv = open(frecv_name, 'w')
 	fsent = open(fsent_name, 'w')
 	fenergest = open(fenergest_name, 'w')
+	fsamples = open(fsamples_name, 'w')
 
 	# Write CSV headers
 	frecv.write("time_recv\tdest\tsrc\tseqn\thops\n")
 	fsent.write("time_sent\tdest\tsrc\tseqn\tstatus\n")
 	fenergest.write("time\tnode\tcnt\tcpu\tlpm\ttx\trx\n")
+	fsamples.write("time_recv\tsrc\tseqn\tidx\tvalue\n")
 
 	if testbed:
 		# Regex for testbed experiments
@@ -154,12 +209,17 @@ def parse_file(log_file, testbed=False):
 			r"(?P<src1>\d+).(?P<src2>\d+)'".format(testbed_record_pattern))
 		regex_recv = re.compile(r"{}'App: Recv from (?P<src1>\w+):(?P<src2>\w+) "
 			r"seqn (?P<seqn>\d+) hops (?P<hops>\d+)'".format(testbed_record_pattern))
-		regex_sent = re.compile(r"{}'App: Send seqn (?P<seqn>\d+)'".format(
-			testbed_record_pattern))
+		regex_sent = re.compile(r"{}'App: Send seqn (?P<seqn>\d+)"
+			r"(?: samples \d+ len \d+)?'".format(testbed_record_pattern))
+		regex_sink = re.compile(r"{}'App: I am sink ".format(testbed_record_pattern))
 		regex_notsent = re.compile(r"{}'App: packet with seqn (?P<seqn>\d+) could not "
 			r"be scheduled\.'".format(testbed_record_pattern))
+		regex_noresend = re.compile(r"{}'App: cannot resend seqn (?P<seqn>\d+)'".format(
+			testbed_record_pattern))
 		regex_dc = re.compile(r"{}'Energest: (?P<cnt>\d+) (?P<cpu>\d+) "
 			r"(?P<lpm>\d+) (?P<tx>\d+) (?P<rx>\d+)'".format(testbed_record_pattern))
+		regex_samples = re.compile(r"{}'App: Samples from (?P<src1>\w+):(?P<src2>\w+) "
+			r"seqn (?P<seqn>\d+) data (?P<data>[0-9a-f]+)'".format(testbed_record_pattern))
 	else:
 		# Regular expressions --- different for COOJA w/o GUI
 		record_pattern = r"(?P<time>[\w:.]+)\s+ID:(?P<self_id>\d+)\s+"
@@ -169,15 +229,24 @@ def parse_file(log_file, testbed=False):
 			r"seqn (?P<seqn>\d+) hops (?P<hops>\d+)".format(record_pattern))
 		regex_sent = re.compile(r"{}App: Send seqn (?P<seqn>\d+)".format(
 			record_pattern))
+		regex_sink = re.compile(r"{}App: I am sink ".format(record_pattern))
 		regex_notsent = re.compile(r"{}App: packet with seqn (?P<seqn>\d+) could not "
 			r"be scheduled\.".format(record_pattern))
+		regex_noresend = re.compile(r"{}App: cannot resend seqn (?P<seqn>\d+)".format(
+			record_pattern))
 		regex_dc = re.compile(r"{}Energest: (?P<cnt>\d+) (?P<cpu>\d+) "
 			r"(?P<lpm>\d+) (?P<tx>\d+) (?P<rx>\d+)".format(record_pattern))
+		regex_samples = re.compile(r"{}App: Samples from (?P<src1>\w+):(?P<src2>\w+) "
+			r"seqn (?P<seqn>\d+) data (?P<data>[0-9a-f]+)".format(record_pattern))
 
 	# Node list and dictionaries for later processing
 	nodes = []
+	sinks = set()
 	drecv = {}
 	dsent = {}
+	nsamples = 0
+	nbytes = 0
+	nrefused = 0 # CMD_RESEND of a frame no longer kept
 	
 	# Parse log file and add data to CSV files
 	with open(log_file, 'r') as f:
@@ -194,14 +263,19 @@ def parse_file(log_file, testbed=False):
 				# Continue with the following line
 				continue
 
+			# Sink boot (there may be several)
+			m = regex_sink.match(line)
+			if m:
+				sinks.add(int(m.group("self_id")))
+				continue
+
 			# RECV 
 			m = regex_recv.match(line)
 			if m:
 				# Get dictionary with data
 				d = m.groupdict()
 				if testbed:
-					ts = datetime.strptime(d["time"], '%Y-%m-%d %H:%M:%S,%f')
-					ts = ts.timestamp()
+					ts = testbed_timestamp(d["time"])
 					src_addr = "{}:{}".format(d["src1"], d["src2"])
 					try:
 						src = addr_id_map[src_addr]
@@ -219,13 +293,33 @@ def parse_file(log_file, testbed=False):
 				frecv.write("{}\t{}\t{}\t{}\t{}\n".format(ts, dest, src, seqn, hops))
 				continue
 
+			# Multi-sample payload
+			m = regex_samples.match(line)
+			if m:
+				d = m.groupdict()
+				if testbed:
+					ts = testbed_timestamp(d["time"])
+					src = addr_id_map.get("{}:{}".format(d["src1"], d["src2"]))
+				else:
+					ts = d["time"]
+					src = int(d["src1"], 16)
+				try:
+					seqn, samples = decode_samples(d["data"])
+				except ValueError as e:
+					print("Malformed payload from {}: {}".format(src, e))
+					continue
+				for idx, value in enumerate(samples):
+					fsamples.write("{}\t{}\t{}\t{}\t{}\n".format(ts, src, seqn, idx, value))
+				nsamples += len(samples)
+				nbytes += len(d["data"]) // 2
+				continue
+
 			# SENT
 			m = regex_sent.match(line)
 			if m:
 				d = m.groupdict()
 				if testbed:
-					ts = datetime.strptime(d["time"], '%Y-%m-%d %H:%M:%S,%f')
-					ts = ts.timestamp()
+					ts = testbed_timestamp(d["time"])
 				else:
 					ts = d["time"]
 				src = int(d["self_id"])
@@ -244,8 +338,7 @@ def parse_file(log_file, testbed=False):
 			if m:
 				d = m.groupdict()
 				if testbed:
-					ts = datetime.strptime(d["time"], '%Y-%m-%d %H:%M:%S,%f')
-					ts = ts.timestamp()
+					ts = testbed_timestamp(d["time"])
 				else:
 					ts = d["time"]
 				src = int(d["self_id"])
@@ -259,13 +352,19 @@ def parse_file(log_file, testbed=False):
 
 				continue
 
+			# CMD_RESEND refused
+			m = regex_noresend.match(line)
+			if m:
+				print("Node {}: cannot resend seqn {}".format(m.group("self_id"), m.group("seqn")))
+				nrefused += 1
+				continue
+
 			# Energest Duty Cycle
 			m = regex_dc.match(line)
 			if m:
 				d = m.groupdict()
 				if testbed:
-					ts = datetime.strptime(d["time"], '%Y-%m-%d %H:%M:%S,%f')
-					ts = ts.timestamp()
+					ts = testbed_timestamp(d["time"])
 				else:
 					ts = d["time"]
 				# Write to CSV file
@@ -276,11 +375,21 @@ def parse_file(log_file, testbed=False):
 	frecv.close()
 	fsent.close()
 	fenergest.close()
+	fsamples.close()
+
+	if nrefused:
+		print("Resend: {} requests refused\n".format(nrefused))
+
+	if nsamples:
+		print("Payload: {} samples in {} bytes ({:.2f} bytes/reading)\n".format(
+			nsamples, nbytes, nbytes / nsamples))
 
 	# Nodes that did not manage to send data
+	if not sinks:
+		sinks.add(sink_id)
 	fails = []
 	for node_id in sorted(nodes):
-		if node_id == sink_id:
+		if node_id in sinks:
 			continue
 		if node_id not in dsent.keys():
 			fails.append(node_id)
@@ -292,18 +401,82 @@ def parse_file(log_file, testbed=False):
 		print("") # To separate clearly from the following set of prints
 
 	# Compute node PDR
-	compute_node_pdr(fsent_name, frecv_name)
+	nnodes, sent, recv = compute_node_pdr(fsent_name, frecv_name)
 
 	# Compute node duty cycle
-	compute_node_duty_cycle(fenergest_name)
+	dc_avg, dc_max = compute_node_duty_cycle(fenergest_name, sinks)
+
+	return {'log': log_file, 'nodes': nnodes, 'sent': sent, 'recv': recv,
+		'pdr': 100 * recv / sent if sent else float('nan'),
+		'dc_avg': dc_avg, 'dc_max': dc_max, 'resend_refused': nrefused}
+
+
+def parse_worker(job):
+	"""Parse a log in a worker process, return (summary or None, output)"""
+	log_file, testbed = job
+	out = io.StringIO()
+	stdout, sys.stdout = sys.stdout, out
+	try:
+		summary = parse_file(log_file, testbed=testbed)
+	except Exception as e:
+		print("Error parsing {}: {}".format(log_file, e))
+		summary = None
+	finally:
+		sys.stdout = stdout
+	return summary, out.getvalue()
+
+
+def fetch_jobs(job_ids):
+	"""Return the logs of the testbed jobs, downloading the missing ones
+	with get-test.sh (testbed client, or the TESTBED_ARCHIVE directory)"""
+	missing = [j for j in job_ids
+		if not os.path.exists(os.path.join(jobs_dir, "job_{}".format(j), "test.log"))]
+	for j in missing:
+		print("Fetching job {}".format(j))
+		if subprocess.call(["bash", os.path.join(jobs_dir, "get-test.sh"), j], cwd=jobs_dir):
+			print("get-test.sh failed for job {}".format(j))
+	logs = []
+	for j in job_ids:
+		log_file = os.path.join(jobs_dir, "job_{}".format(j), "test.log")
+		if os.path.isfile(log_file):
+			logs.append(log_file)
+		else:
+			print("Job {}: no log in {}".format(j, os.path.dirname(log_file)))
+	return logs
+
+
+def parse_batch(jobs, processes, fsummary=None):
+	"""Parse the logs concurrently, then print their outputs in order and
+	a summary line per run"""
+	with multiprocessing.Pool(processes) as pool:
+		results = pool.map(parse_worker, jobs, chunksize=1)
+
+	rows = []
+	for (log_file, testbed), (summary, output) in zip(jobs, results):
+		print(output)
+		if summary is not None:
+			rows.append(summary)
+	print("\n===== Runs =====")
+	df = pd.DataFrame(rows, columns=['log', 'nodes', 'sent', 'recv', 'pdr', 'dc_avg', 'dc_max'])
+	print(df.to_string(index=False, float_format='{:.3f}'.format))
+	if fsummary:
+		df.to_csv(fsummary, sep='\t', index=False, float_format='%.3f', na_rep='nan')
+		print("Saving runs summary in: {}".format(fsummary))
+	return len(rows) == len(jobs)
 
 
 def parse_args():
 	parser = argparse.ArgumentParser()
-	parser.add_argument('logfile', action="store", type=str,
-		help="data collection logfile to be parsed and analyzed.")
+	parser.add_argument('logfile', action="store", type=str, nargs='*',
+		help="data collection logfiles to be parsed and analyzed.")
 	parser.add_argument('-t', '--testbed', action='store_true',
 		help="flag for testbed experiments")
+	parser.add_argument('--job', action='append', default=[], metavar='ID',
+		help="testbed job (testbed/job_ID/test.log, fetched if missing), repeatable")
+	parser.add_argument('-p', '--processes', type=int, default=None,
+		help="logs parsed in parallel (default: one per core)")
+	parser.add_argument('-s', '--summary', metavar='FILE',
+		help="with several logs, save one line per run in FILE (TSV)")
 	return parser.parse_args()
 
 
@@ -311,14 +484,27 @@ if __name__ == '__main__':
 	args = parse_args()
 	print(args)
 
-	if not args.logfile:
+	if not args.logfile and not args.job:
 		print("Log file needs to be specified as 1st positional argument.")
-	if not os.path.exists(args.logfile):
-		print("The logfile argument {} does not exist.".format(args.logfile))
 		sys.exit(1)
-	if not os.path.isfile(args.logfile):
-		print("The logfile argument {} is not a file.".format(args.logfile))
+	for logfile in args.logfile:
+		if not os.path.exists(logfile):
+			print("The logfile argument {} does not exist.".format(logfile))
+			sys.exit(1)
+		if not os.path.isfile(logfile):
+			print("The logfile argument {} is not a file.".format(logfile))
+			sys.exit(1)
+
+	jobs = [(logfile, args.testbed) for logfile in args.logfile]
+	job_logs = fetch_jobs(args.job)
+	jobs += [(logfile, True) for logfile in job_logs]
+	if not jobs:
 		sys.exit(1)
 
 	# Parse log file, create CSV files, and print some stats
-	parse_file(args.logfile, testbed=args.testbed)
+	if len(jobs) == 1 and not args.summary:
+		parse_file(jobs[0][0], testbed=jobs[0][1])
+	elif not parse_batch(jobs, args.processes, args.summary):
+		sys.exit(1)
+	if len(job_logs) < len(args.job):
+		sys.exit(1)
@@ -0,0 +1,107 @@
+#include <string.h>
+#include "payload_codec.h"
+/*---------------------------------------------------------------------------*/
+/* Map signed values to unsigned so that small magnitudes get short varints */
+#define ZIGZAG_ENC(v) ((uint16_t)(((uint16_t)(v) << 1) ^ (uint16_t)((v) < 0 ? 0xFFFF : 0)))
+#define ZIGZAG_DEC(u) ((int16_t)(((u) >> 1) ^ (uint16_t)(-(int16_t)((u) & 1))))
+/*---------------------------------------------------------------------------*/
+/* Write an unsigned varint (7 bits per byte, MSB = continuation) */
+static uint8_t put_varint(uint16_t value, uint8_t *buf, uint8_t len)
+{
+  uint8_t n = 0;
+
+  do
+  {
+    if (n >= len)
+      return 0;
+    buf[n] = value & 0x7F;
+    value >>= 7;
+    if (value != 0)
+      buf[n] |= 0x80;
+    n++;
+  } while (value != 0);
+
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/* Read an unsigned varint, returns the number of bytes consumed (0 on error) */
+static uint8_t get_varint(const uint8_t *buf, uint8_t len, uint16_t *value)
+{
+  uint8_t n = 0, shift = 0;
+
+  *value = 0;
+  while (n < len && shift < 16)
+  {
+    *value |= (uint16_t)(buf[n] & 0x7F) << shift;
+    if (!(buf[n++] & 0x80))
+      return n;
+    shift += 7;
+  }
+  return 0; // truncated or too long
+}
+/*---------------------------------------------------------------------------*/
+void payload_frame_init(struct payload_frame *frame, uint16_t seqn)
+{
+  frame->seqn = seqn;
+  frame->count = 0;
+}
+/*---------------------------------------------------------------------------*/
+int payload_frame_add(struct payload_frame *frame, int16_t sample)
+{
+  if (frame->count >= PAYLOAD_MAX_SAMPLES)
+    return 0;
+
+  frame->samples[frame->count++] = sample;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t payload_encode(const struct payload_frame *frame, uint8_t *buf, uint8_t len)
+{
+  uint8_t i, n, pos = PAYLOAD_HDR_LEN;
+  int16_t prev = 0, delta;
+
+  if (len < PAYLOAD_HDR_LEN)
+    return 0;
+
+  buf[0] = frame->seqn & 0xFF;
+  buf[1] = frame->seqn >> 8;
+  buf[2] = frame->count;
+
+  for (i = 0; i < frame->count; i++)
+  {
+    delta = frame->samples[i] - prev; // the first sample is a delta from 0
+    n = put_varint(ZIGZAG_ENC(delta), buf + pos, len - pos);
+    if (n == 0)
+      return 0;
+    pos += n;
+    prev = frame->samples[i];
+  }
+
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+int payload_decode(const uint8_t *buf, uint8_t len, struct payload_frame *frame)
+{
+  uint8_t i, n, pos = PAYLOAD_HDR_LEN;
+  uint16_t value;
+  int16_t prev = 0;
+
+  if (len < PAYLOAD_HDR_LEN || buf[2] > PAYLOAD_MAX_SAMPLES)
+    return 0;
+
+  frame->seqn = buf[0] | ((uint16_t)buf[1] << 8);
+  frame->count = buf[2];
+
+  for (i = 0; i < frame->count; i++)
+  {
+    n = get_varint(buf + pos, len - pos, &value);
+    if (n == 0)
+      return 0;
+    pos += n;
+    prev += ZIGZAG_DEC(value);
+    frame->samples[i] = prev;
+  }
+
+  return pos == len;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,39 @@
+#ifndef PAYLOAD_CODEC_H
+#define PAYLOAD_CODEC_H
+/*---------------------------------------------------------------------------*/
+#include <stdint.h>
+/*---------------------------------------------------------------------------*/
+#define PAYLOAD_MAX_SAMPLES 16
+/*---------------------------------------------------------------------------*/
+/* Multi-sample frame carried in a single collect packet.
+ * On air the frame is encoded as:
+ *   seqn (2 bytes, little endian) | count (1 byte) |
+ *   first sample (zigzag varint) | count-1 deltas (zigzag varint)
+ * so slowly varying readings take a single byte each. */
+struct payload_frame
+{
+  uint16_t seqn;
+  uint8_t count;
+  int16_t samples[PAYLOAD_MAX_SAMPLES];
+};
+/*---------------------------------------------------------------------------*/
+/* Worst case encoded size: header + 3 bytes per varint */
+#define PAYLOAD_HDR_LEN 3
+#define PAYLOAD_MAX_LEN (PAYLOAD_HDR_LEN + 3 * PAYLOAD_MAX_SAMPLES)
+/*---------------------------------------------------------------------------*/
+/* Reset the frame and set the sequence number of the next packet */
+void payload_frame_init(struct payload_frame *frame, uint16_t seqn);
+/*---------------------------------------------------------------------------*/
+/* Append a reading to the frame.
+ * Returns zero if the frame is already full, non-zero otherwise. */
+int payload_frame_add(struct payload_frame *frame, int16_t sample);
+/*---------------------------------------------------------------------------*/
+/* Encode the frame into buf (at most len bytes).
+ * Returns the number of bytes written, zero if buf is too short. */
+uint8_t payload_encode(const struct payload_frame *frame, uint8_t *buf, uint8_t len);
+/*---------------------------------------------------------------------------*/
+/* Decode len bytes of buf into frame.
+ * Returns zero if the buffer is malformed, non-zero otherwise. */
+int payload_decode(const uint8_t *buf, uint8_t len, struct payload_frame *frame);
+/*---------------------------------------------------------------------------*/
+#endif //PAYLOAD_CODEC_H
@@ -18,7 +18,20 @@
 
 #define CC2538_RF_CONF_CHANNEL        26
 
-#define COFFEE_CONF_SIZE              0
+/* Channels sched_collect hops on, e.g. the four clear of Wi-Fi 1/6/11
+ * (make HOPPING=1; default: { 26 }, no hopping) */
+/* #define SCHED_COLLECT_CONF_CHANNELS { 15, 20, 25, 26 } */
+
+/* Sinks sharing the epoch schedule, e.g. Firefly nodes 1 and 18 of the
+ * testbed: { {{0xF7, 0x9C}}, {{0xF3, 0x8B}} } (default: node 1 only) */
+/* #define SCHED_COLLECT_CONF_SINKS   { {{0xF7, 0x9C}}, {{0xF3, 0x8B}} } */
+
+/* Coffee holds the boot counter of the sink and, with make STORE=1, the
+ * store-and-forward queue of sched_collect */
+#ifndef SCHED_COLLECT_CONF_STORE
+#define SCHED_COLLECT_CONF_STORE      0
+#endif
+#define COFFEE_CONF_SIZE              (64 * 1024) // room for msg_store and garbage collection
 
 #define LPM_CONF_MAX_PM               LPM_PM0
 /*---------------------------------------------------------------------------*/
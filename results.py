@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+# Results store of the experiment runs: one Parquet file with a row per run
+# and node, together with the configuration of the run, so that runs can be
+# compared without parsing their logs again.
+#
+#   ./parse-stats.py experiments/cooja_udgm_1%/test_nogui_udgm.log
+#   ./results.py ingest experiments/*/
+#   ./results.py report --where "platform == 'cooja'"
+#   ./results.py compare cooja_udgm_1% cooja_udgm_rndDelay
+#
+# ingest reads the CSV files of parse-stats.py (-pdr, -dc and -recv) of each
+# run directory. The configuration comes from the directory name
+# (<platform>_<topology>_<slot fraction>% for TDMA, the strategy instead of
+# the slot fraction for rnd_delay, or rndDelay, and csma) and from an
+# optional run.json in the directory, whose keys override it, e.g.
+# {"guard_fraction": 0.05}. Ingesting a run again replaces its rows.
+
+import os
+import re
+import sys
+import glob
+import json
+import argparse
+import pandas as pd
+
+default_store = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+	"experiments", "results.parquet")
+
+# Configuration columns, in this order before the per-node figures
+meta_columns = ['run', 'platform', 'topology', 'scheduler', 'slot_fraction',
+	'guard_fraction', 'test_id']
+
+
+def run_metadata(rundir):
+	"""Configuration of a run from its directory name and run.json"""
+	run = os.path.basename(os.path.normpath(rundir))
+	meta = {'run': run, 'platform': None, 'topology': None, 'scheduler': 'tdma',
+		'slot_fraction': None, 'guard_fraction': None, 'test_id': None}
+
+	parts = run.split('_')
+	meta['platform'] = parts[0]
+	if meta['platform'] == 'testbed':
+		meta['topology'] = 'testbed'
+	elif len(parts) > 2:
+		meta['topology'] = parts[1]
+	m = re.match(r'([\d.]+)%$', parts[-1])
+	if m:
+		meta['slot_fraction'] = float(m.group(1)) / 100
+	elif parts[-1] in ('rndDelay', 'rnd_delay'):
+		meta['scheduler'] = 'rnd_delay'
+	elif parts[-1] == 'csma':
+		meta['scheduler'] = 'csma'
+
+	# Testbed job description
+	job = os.path.join(rundir, 'testFile.json')
+	if os.path.exists(job):
+		with open(job, 'r') as f:
+			meta['test_id'] = json.load(f).get('test_id')
+
+	override = os.path.join(rundir, 'run.json')
+	if os.path.exists(override):
+		with open(override, 'r') as f:
+			meta.update(json.load(f))
+	return meta
+
+
+def load_run(rundir):
+	"""Per-node rows of a run, None if parse-stats.py did not process it"""
+	pdr_files = glob.glob(os.path.join(rundir, '*-pdr.csv'))
+	if not pdr_files:
+		return None
+	common = pdr_files[0][:-len('-pdr.csv')]
+
+	df = pd.read_csv(pdr_files[0], sep='\t')
+	df['node'] = df.node.astype(int)
+	if os.path.exists(common + '-dc.csv'):
+		dc = pd.read_csv(common + '-dc.csv', sep='\t')
+		dc['node'] = dc.node.astype(int)
+		df = df.merge(dc, on='node', how='outer')
+	if os.path.exists(common + '-recv.csv'):
+		recv = pd.read_csv(common + '-recv.csv', sep='\t')
+		hops = recv.groupby('src').hops.mean().rename('hops_avg')
+		df = df.merge(hops, left_on='node', right_index=True, how='left')
+
+	for key, value in run_metadata(rundir).items():
+		df[key] = value
+	return df
+
+
+def ingest(args):
+	store = pd.read_parquet(args.store) if os.path.exists(args.store) else None
+	runs = []
+	for rundir in args.rundirs:
+		df = load_run(rundir)
+		if df is None:
+			print("Skipping {}: no -pdr.csv, run parse-stats.py first".format(rundir))
+			continue
+		print("Run {}: {} nodes".format(df.run.iloc[0], len(df.index)))
+		runs.append(df)
+	if not runs:
+		return
+
+	new = pd.concat(runs, ignore_index=True)
+	if store is not None:
+		store = store[~store.run.isin(new.run.unique())]
+		new = pd.concat([store, new], ignore_index=True)
+	cols = meta_columns + [c for c in new.columns if c not in meta_columns]
+	new = new[cols].sort_values(['run', 'node']).reset_index(drop=True)
+	for col in ['run', 'platform', 'topology', 'scheduler']:
+		new[col] = new[col].astype('category')
+	new.to_parquet(args.store, index=False)
+	print("Saved {} runs ({} rows) in {}".format(new.run.nunique(), len(new.index), args.store))
+
+
+def load_store(args):
+	if not os.path.exists(args.store):
+		sys.exit("No results store {}, see ./results.py ingest".format(args.store))
+	df = pd.read_parquet(args.store)
+	if args.where:
+		df = df.query(args.where)
+	return df
+
+
+def run_summary(df):
+	"""One row per run: overall PDR, duty cycle over the nodes, hops"""
+	g = df.groupby('run', observed=True)
+	summary = g[meta_columns[1:]].first()
+	summary['nodes'] = g.node.count()
+	summary['sent'] = g.sent.sum().astype(int)
+	summary['recv'] = g.recv.sum().astype(int)
+	summary['pdr'] = 100 * summary.recv / summary.sent
+	summary['pdr_min'] = g.pdr.min()
+	if 'dc' in df.columns:
+		summary['dc_avg'] = g.dc.mean()
+		summary['dc_max'] = g.dc.max()
+	if 'hops_avg' in df.columns:
+		summary['hops_avg'] = g.hops_avg.mean()
+	return summary
+
+
+def report(args):
+	summary = run_summary(load_store(args))
+	summary = summary.sort_values(args.sort.split(','))
+	summary = summary.drop(columns=[c for c in ['guard_fraction', 'test_id']
+		if summary[c].isna().all()])
+	with pd.option_context('display.max_rows', None, 'display.width', 200):
+		print(summary.to_string(float_format='{:.3f}'.format,
+			formatters={'slot_fraction': '{:g}'.format}))
+	if args.csv:
+		summary.to_csv(args.csv, sep='\t', float_format='%.3f')
+		print("Saved report in {}".format(args.csv))
+
+
+def compare(args):
+	df = load_store(args)
+	figures = [c for c in ['pdr', 'dc', 'hops_avg'] if c in df.columns]
+	a = df[df.run == args.run_a].set_index('node')[figures]
+	b = df[df.run == args.run_b].set_index('node')[figures]
+	if a.empty or b.empty:
+		sys.exit("Unknown run {}".format(args.run_a if a.empty else args.run_b))
+
+	# Node by node, then the runs as a whole
+	diff = a.join(b, how='outer', lsuffix='_a', rsuffix='_b')
+	for col in figures:
+		diff[col + '_diff'] = diff[col + '_b'] - diff[col + '_a']
+	with pd.option_context('display.max_rows', None, 'display.width', 200):
+		print("a: {}\nb: {}\n".format(args.run_a, args.run_b))
+		print(diff.to_string(float_format='{:.3f}'.format))
+		print("")
+		print(run_summary(df[df.run.isin([args.run_a, args.run_b])]).T.to_string())
+
+
+def parse_args():
+	parser = argparse.ArgumentParser()
+	parser.add_argument('-s', '--store', default=default_store,
+		help="Parquet results store (default experiments/results.parquet)")
+	sub = parser.add_subparsers(dest='cmd')
+	sub.required = True
+
+	p = sub.add_parser('ingest', help="add runs to the store")
+	p.add_argument('rundirs', nargs='+', help="run directories (with parse-stats.py output)")
+	p.set_defaults(func=ingest)
+
+	p = sub.add_parser('report', help="one line per run")
+	p.add_argument('-w', '--where', help="pandas query on the rows, e.g. \"topology == 'udgm'\"")
+	p.add_argument('--sort', default='platform,topology,scheduler,slot_fraction',
+		help="sort columns (comma separated)")
+	p.add_argument('--csv', help="also save the report as TSV")
+	p.set_defaults(func=report)
+
+	p = sub.add_parser('compare', help="node by node comparison of two runs")
+	p.add_argument('run_a')
+	p.add_argument('run_b')
+	p.add_argument('-w', '--where', help=argparse.SUPPRESS)
+	p.set_defaults(func=compare)
+	return parser.parse_args()
+
+
+if __name__ == '__main__':
+	args = parse_args()
+	args.func(args)
@@ -7,28 +7,114 @@
 #include <stdio.h>
 #include "core/net/linkaddr.h"
 #include "node-id.h"
+#include "cfs/cfs.h"
 #include "sched_collect.h"
+#include "msg_store.h"
+#include "slot_sched.h"
+#include "sink_stats.h"
 /*---------------------------------------------------------------------------*/
 #define RSSI_THRESHOLD -95 // filter bad links
 #define SYNCH_SLOT ((clock_time_t)(CLOCK_SECOND * 1))
 #define BEACON_FORWARD_DELAY (random_rand() % SYNCH_SLOT)
-#define SEQN_OVERFLOW_TH 3 // number of accepting SEQN after overflow
+#define SEQN_NEWER(a, b) ((int16_t)((uint16_t)(a) - (uint16_t)(b)) > 0) // serial number arithmetic (RFC 1982)
+#define MAX_MISSED_EPOCHS 3 // epochs without beacons before dropping the sync state
 #define SLOT_FRACTION 0.01
 #define GUARD_FRACTION 0.05
 #define SLOT_TIME ((clock_time_t)(CLOCK_SECOND * MAX_HOPS * SLOT_FRACTION))
 #define GUARD_TIME ((clock_time_t)(CLOCK_SECOND * MAX_HOPS * GUARD_FRACTION))
+#define SYNC_WINDOW (2 * GUARD_TIME + MAX_HOPS * SYNCH_SLOT) // listen time after wake up
+#define EMERGENCY_WINDOW SLOT_TIME // urgent packets, contention based, between flood and slots
+#define EMERGENCY_JITTER (random_rand() % (SLOT_TIME / 2)) // leave the rest of the window to the relays
+#define EMERGENCY_GUARD (SLOT_TIME / 2) // emergency wake-up: listen before and after the window
+#define EMERGENCY_WAKEUPS SCHED_COLLECT_CONF_EMERGENCY_WAKEUPS
+#define SLOTS_START (MAX_HOPS * SYNCH_SLOT + EMERGENCY_WINDOW) // first collection slot from epoch start
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+#define MY_SLOT tx_slot
+#define WINDOW_SLOTS (slot_msg.nslots + slot_msg.njoin)
+#define SLOT_JITTER (tx_rank * (SLOT_TIME / SLOT_SCHED_SHARE)) // the nodes of a slot take turns
+#else
+#define MY_SLOT (node_id - 2)
+#define WINDOW_SLOTS (MAX_NODES - 1)
+#define SLOT_JITTER 0
+#endif
+#define COLLECT_OFFSET (SLOTS_START + MY_SLOT * SLOT_TIME)   // my slot from epoch start
+#define WINDOW_END (SLOTS_START + WINDOW_SLOTS * SLOT_TIME) // collection end from epoch start
+/* Emergency wake-up k (1..EMERGENCY_WAKEUPS) from epoch start: evenly
+ * spaced after the window of the flood, those in the collection window are
+ * skipped */
+#define EMERGENCY_AT(k) (MAX_HOPS * SYNCH_SLOT + (clock_time_t)((uint32_t)(k) * EPOCH_DURATION / (EMERGENCY_WAKEUPS + 1)))
+#define JOIN_LISTEN SYNCH_SLOT                  // scan window of an unsynchronized node
+#define JOIN_BACKOFF_MIN SYNCH_SLOT             // first radio off time between scans
+#define JOIN_BACKOFF_MAX (EPOCH_DURATION / 2 / HOP_CHANNELS) // backoff cap, the same time per channel
+#define JOIN_REPLY_DELAY (random_rand() % (SYNCH_SLOT / 4))
+#define JOIN_REQUEST 0x4A // join request payload (1 byte, told apart from beacons by its size)
+#define SLOTTED (SCHED_COLLECT_CONF_STRATEGY == SCHED_COLLECT_TDMA) // else the radio is always on
+#if SCHED_COLLECT_CONF_STRATEGY == SCHED_COLLECT_RND_DELAY
+#define SEND_DELAY (2 * CLOCK_SECOND + random_rand() % (EPOCH_DURATION / 2 - 2 * CLOCK_SECOND)) // after queuing
+#else
+#define SEND_DELAY (random_rand() % (CLOCK_SECOND / 8)) // CSMA: jitter only
+#endif
+#define HOP_CHANNELS (sizeof(hop_channels) / sizeof(hop_channels[0]))
+#if SLOTTED
+/* The flood of epoch seqn: every channel once in each block of
+ * HOP_CHANNELS epochs (a listener on one channel hears a flood within two
+ * blocks), from an offset mixed from the boot id and the block, so that
+ * the floods of two schedules (two sinks, a rebooted sink) meet */
+#define BEACON_MIX(boot_id, block) ((uint16_t)(((uint16_t)(block) ^ ((uint16_t)(boot_id) << 8)) * 40503u) >> 8)
+#define BEACON_CHANNEL(boot_id, seqn) \
+  (hop_channels[((uint16_t)(seqn) + BEACON_MIX(boot_id, (uint16_t)(seqn) / HOP_CHANNELS)) % HOP_CHANNELS])
+#define SCAN_EPOCHS (2 * HOP_CHANNELS - 1) // epochs on one channel to hear any schedule
+#else
+#define BEACON_CHANNEL(boot_id, seqn) (hop_channels[0]) // the radio stays on one channel
+#define SCAN_EPOCHS 1
+#endif
+#define EPOCH_CHANNEL BEACON_CHANNEL(conn_ptr->boot_id, conn_ptr->beacon_seqn)
+#if SLOTTED && SCHED_COLLECT_CONF_SLOT_HOPPING
+#define SLOT_CHANNEL(seqn, slot) (hop_channels[((uint16_t)(seqn) + 1 + (slot)) % HOP_CHANNELS])
+#elif SLOTTED
+#define SLOT_CHANNEL(seqn, slot) (hop_channels[(uint16_t)(seqn) % HOP_CHANNELS]) // one per epoch
+#else
+#define SLOT_CHANNEL(seqn, slot) BEACON_CHANNEL(0, seqn)
+#endif
+#define SLOT_GUARD (SLOTTED && HOP_CHANNELS > 1 ? SLOT_TIME / 4 : 0) // let receivers with a late clock switch first
+#define NUM_SINKS (sizeof(sinks) / sizeof(sinks[0]))
+#define SINK_BEACON_DELAY (random_rand() % (SYNCH_SLOT / 2)) // sinks after the first: do not collide with its beacon
+#define BOOT_FILE "sc_boot" // sink boot counter, the boot id
 /*---------------------------------------------------------------------------*/
 PROCESS(sink_process, "Sink process");
 PROCESS(node_process, "Node process");
 /*---------------------------------------------------------------------------*/
+struct collect_header;
 /* Callback function declarations */
 void bc_recv(struct broadcast_conn *conn, const linkaddr_t *sender);
 void uc_recv(struct unicast_conn *c, const linkaddr_t *from);
+void uc_sent(struct unicast_conn *c, int status, int num_tx);
 /* Other function declarations */
 void send_beacon();
-void send_collect();
+void send_collect(void *p);
+void send_urgent(void *p);
+void init_header(struct collect_header *hdr, uint8_t prio);
+void select_command(struct sched_collect_conn *conn);
+void deliver_batch(const linkaddr_t *source, uint8_t hops);
+void select_slots(uint16_t seqn);
+void handle_command(struct sched_collect_conn *conn);
 void sleep_cb(void *p) { NETSTACK_MAC.off(false); }
+void rescan_cb(void *p);
 void wakeup_cb(void *p);
+void sync_timeout_cb(void *p);
+void start_join(void);
+void join_listen_cb(void *p);
+void join_sleep_cb(void *p);
+void send_join_beacon(void *p);
+void slot_cb(void *p);
+void plan_emergency(clock_time_t elapsed);
+void emergency_cb(void *p);
+void emergency_end_cb(void *p);
+void set_channel(uint8_t channel);
+void sink_epoch(clock_time_t elapsed, bool flood);
+void plan_epoch(clock_time_t tot_delay);
+void plan_send(uint8_t prio);
+uint8_t next_boot_id(void);
 /*---------------------------------------------------------------------------*/
 /* Rime Callback structures */
 struct broadcast_callbacks bc_cb = {
@@ -36,41 +122,142 @@ struct broadcast_callbacks bc_cb = {
     .sent = NULL};
 struct unicast_callbacks uc_cb = {
     .recv = uc_recv,
+#if SCHED_COLLECT_CONF_STORE
+    .sent = uc_sent};
+#else
     .sent = NULL};
+#endif
 /*---------------------------------------------------------------------------*/
 static struct etimer beacon_etimer;
 static struct ctimer beacon_ctimer;
 static struct etimer collect_timer;
 static struct ctimer sleep_timer;
 static struct ctimer wakeup_timer;
+static struct ctimer sync_timer;
+static struct ctimer join_timer;
+static struct ctimer join_reply_timer;
+static struct ctimer slot_timer;
+static struct ctimer urgent_timer;
+static struct ctimer emergency_timer;
+#if !SLOTTED
+static struct ctimer send_timer; // random delay and CSMA strategies
+#endif
+static const uint8_t hop_channels[] = SCHED_COLLECT_CHANNELS;
+static const linkaddr_t sinks[] = SCHED_COLLECT_SINKS;
+static uint8_t sink_joining; // epochs left to listen for the schedule of the other sinks
+/* On a schedule not led by the first sink (sinks started apart), whose
+ * floods come at another phase: the sink listens for them between its
+ * windows, its nodes for a whole epoch every RESCAN_EPOCHS */
+#define RESCAN_EPOCHS SCHED_COLLECT_CONF_RESCAN_EPOCHS
+#define RESCANNING (conn_ptr->leader != 0 && (conn_ptr->metric == 0 || conn_ptr->beacon_seqn % RESCAN_EPOCHS == 0))
+static uint8_t join_channel; // index of the channel of the next join scan
+static bool sink_new_epoch; // the schedule adopted by the sink is in a new epoch
+static clock_time_t join_backoff;
 static clock_time_t process_time;
+static clock_time_t sync_delay; // delay of the accepted beacon, read by node_process
 process_event_t collect_event;
 struct sched_collect_conn *conn_ptr;
+/* Sink command queue, a free entry has cmd.type == CMD_NONE */
+struct cmd_entry
+{
+  struct sched_collect_cmd cmd;
+  uint8_t tries; // beacons left before dropping the command
+};
+static struct cmd_entry cmd_queue[CMD_QUEUE_SIZE];
+static uint8_t cmd_next; // round robin among queued commands
+static uint8_t cmd_id;
+#if SCHED_COLLECT_CONF_STORE
+/* Unicasts waiting for their MAC outcome, oldest in bit 0 (1: own batch,
+ * 0: forwarded packet), the MAC reports them in order. A unicast that
+ * does not fit is not sent: its outcome would pop another one's entry. */
+#define TX_FIFO_MAX 8
+static uint8_t tx_fifo, tx_fifo_len;
+static bool batch_pending; // the own batch in flight carries pending_msg
+#endif
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+/* Slot schedule carried by the beacons, SLOT_SCHED_CHUNK entries at a
+ * time: slots[i] is the entry of node id first + i + 2 (slot_sched_get) */
+#define SLOT_SCHED_CHUNK 8
+struct slot_sched_msg
+{
+  uint8_t id;     // node id of the beacon sender
+  uint8_t nslots; // assigned slots, followed by the join slots
+  uint8_t njoin;  // join slots, one per node id while the schedule settles
+  uint8_t first;
+  uint8_t slots[SLOT_SCHED_CHUNK];
+} __attribute__((packed));
+static struct slot_sched_msg slot_msg; // last accepted (node) or next sent (sink)
+static uint8_t my_slot;
+static uint8_t tx_slot; // slot of the current epoch
+static uint8_t tx_rank; // turn in the slot
+/* Neighbors heard in the current and in the previous epoch */
+static uint8_t nbr_now[SLOT_SCHED_NBR_BYTES], nbr_prev[SLOT_SCHED_NBR_BYTES];
+#define SLOT_SCHED_LEN sizeof(struct slot_sched_msg)
+/* Each sink would schedule the nodes it hears on its own */
+typedef char slot_reuse_needs_a_single_sink[NUM_SINKS == 1 ? 1 : -1];
+typedef char slot_reuse_needs_tdma[SLOTTED ? 1 : -1];
+typedef char slot_reuse_entry_overflow[(MAX_NODES - 1) * SLOT_SCHED_SHARE < SLOT_SCHED_NONE ? 1 : -1];
+#define REUSE_RAM (SLOT_SCHED_RAM + sizeof(nbr_now) + sizeof(nbr_prev) + sizeof(slot_msg))
+#else
+#define SLOT_SCHED_LEN 0
+#define REUSE_RAM 0
+#endif
+#if SCHED_COLLECT_CONF_STORE
+#define STORE_RAM MSG_STORE_RAM
+#else
+#define STORE_RAM 0
+#endif
+/* The tables sized by the configuration, and the msg buffers of the
+ * connection (pending and urgent), must fit SCHED_COLLECT_CONF_RAM_BUDGET */
+#define MSG_BUFFERS_RAM (2 * sizeof(struct msg_buffer))
+#define TABLES_RAM (sizeof(cmd_queue) + MSG_BUFFERS_RAM + REUSE_RAM + STORE_RAM + SINK_STATS_RAM)
+typedef char collect_tables_over_ram_budget[TABLES_RAM <= SCHED_COLLECT_CONF_RAM_BUDGET ? 1 : -1];
 
 PROCESS_THREAD(sink_process, ev, data)
 {
   PROCESS_BEGIN();
   collect_event = process_alloc_event();
-  etimer_set(&beacon_etimer, (clock_time_t)0);
+  if (NUM_SINKS > 1)
+  {
+    /* Join the schedule of the sinks already running, if any: listen for
+     * their floods on one channel until every channel had its turn, longer
+     * for later sinks so that the first one starts first at a cold boot */
+    sink_joining = (conn_ptr->sink + 1) * SCAN_EPOCHS;
+    set_channel(hop_channels[0]);
+    NETSTACK_MAC.on();
+    etimer_set(&beacon_etimer, EPOCH_DURATION);
+  }
+  else
+    etimer_set(&beacon_etimer, (clock_time_t)0);
 
   // periodically transmit the synchronization beacon
   while (1)
   {
     PROCESS_WAIT_EVENT();
 
-    if (ev == PROCESS_EVENT_TIMER && etimer_expired(&beacon_etimer))
+    if (ev == PROCESS_EVENT_TIMER && etimer_expired(&beacon_etimer) && sink_joining > 1)
     {
+      sink_joining--;
+      etimer_set(&beacon_etimer, EPOCH_DURATION);
+    }
+    else if (ev == PROCESS_EVENT_TIMER && etimer_expired(&beacon_etimer))
+    {
+      if (sink_joining)
+        printf("collect: no other sink heard, starting the schedule\n");
+      sink_joining = 0;
       NETSTACK_MAC.on();
       conn_ptr->beacon_seqn++;
-      send_beacon(NULL);
-
-      etimer_set(&beacon_etimer, EPOCH_DURATION);
-      etimer_set(&collect_timer, MAX_HOPS * SYNCH_SLOT);
-      ctimer_set(&sleep_timer, MAX_HOPS * SYNCH_SLOT + (MAX_NODES-1) * SLOT_TIME, sleep_cb, NULL);
+      conn_ptr->epoch_start = clock_time();
+      sink_epoch(0, true);
+    }
+    else if (ev == collect_event) // adopted the schedule of a sink before us
+    {
+      sink_epoch(*(clock_time_t *)data, sink_new_epoch);
     }
     else if (ev == PROCESS_EVENT_TIMER && etimer_expired(&collect_timer))
     {
       printf("collect: %u in collection phase\n", node_id);
+      slot_cb(NULL);
     }
   }
   PROCESS_END();
@@ -80,7 +267,6 @@ PROCESS_THREAD(node_process, ev, data)
 {
   PROCESS_BEGIN();
   collect_event = process_alloc_event();
-  clock_time_t tot_delay = 0;
 
   // manage the phases of each epoch
   while (1)
@@ -88,14 +274,9 @@ PROCESS_THREAD(node_process, ev, data)
     PROCESS_WAIT_EVENT();
 
     if (ev == collect_event) // event triggered when a beacon is accepted
-    {
-      tot_delay = (*(clock_time_t *)data);
-      etimer_set(&collect_timer, MAX_HOPS * SYNCH_SLOT + ((node_id - 2) * SLOT_TIME) - tot_delay);
-      ctimer_set(&sleep_timer, MAX_HOPS * SYNCH_SLOT + (MAX_NODES - 1) * SLOT_TIME - tot_delay, sleep_cb, NULL);
-      ctimer_set(&wakeup_timer, EPOCH_DURATION - tot_delay - GUARD_TIME, wakeup_cb, NULL);
-    }
+      plan_epoch(*(clock_time_t *)data); // set all the timers of the strategy
     else if (ev == PROCESS_EVENT_TIMER && etimer_expired(&collect_timer))
-      send_collect();
+      send_collect(NULL);
   }
 
   PROCESS_END();
@@ -104,16 +285,39 @@ PROCESS_THREAD(node_process, ev, data)
 void sched_collect_open(struct sched_collect_conn *conn, uint16_t channels,
                         bool is_sink, const struct sched_collect_callbacks *callbacks)
 {
+  int rank = sched_collect_sink_rank(&linkaddr_node_addr);
+
   /* Create 2 Rime connections: broadcast (for beacons) and unicast (for collection)
    * Start the appropriate process to perform the necessary epoch operations or 
    * use ctimers and callbacks as necessary to schedule these operations.
    */
   conn->pending_msg.busy = false;
+  conn->urgent_msg.busy = false;
+  conn->rx_prio = SCHED_COLLECT_PRIO_NORMAL;
 
   linkaddr_copy(&conn->parent, &linkaddr_null);
   conn->metric = 65535;
   conn->beacon_seqn = 0;
+  conn->boot_id = 0;
+  conn->synced = false;
+  conn->missed = 0;
   conn->callbacks = callbacks;
+  conn->cmd.type = CMD_NONE;
+  memset(conn->cmd_done, 0, sizeof(conn->cmd_done));
+  conn->cmd_done_next = 0;
+  conn->cmd_ack = 0;
+  conn->sink = 0;
+  conn->leader = 0;
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  memset(&slot_msg, 0, sizeof(slot_msg));
+  memset(slot_msg.slots, SLOT_SCHED_NONE, sizeof(slot_msg.slots));
+  slot_msg.njoin = SLOT_SCHED_JOIN_SLOTS;
+  my_slot = SLOT_SCHED_NONE;
+  memset(nbr_now, 0, sizeof(nbr_now));
+  memset(nbr_prev, 0, sizeof(nbr_prev));
+  if (is_sink)
+    slot_sched_init();
+#endif
 
   broadcast_open(&conn->bc, channels, &bc_cb);
   unicast_open(&conn->uc, channels + 1, &uc_cb);
@@ -123,56 +327,151 @@ void sched_collect_open(struct sched_collect_conn *conn, uint16_t channels,
   {
     conn->metric = 0;
     conn->delay = 0;
+    if (rank > 0)
+      conn->sink = conn->leader = rank;
+    /* New boot epoch: lets nodes tell a restarted sink from stale beacons */
+    conn->boot_id = next_boot_id();
+    conn->synced = true;
+    printf("collect: sink %u of %u, boot id %u\n", conn->sink, (unsigned)NUM_SINKS, conn->boot_id);
     process_start(&sink_process, conn);
   }
   else
+  {
+#if SCHED_COLLECT_CONF_STORE
+    tx_fifo = tx_fifo_len = 0;
+    msg_store_init();
+#endif
     process_start(&node_process, conn);
+    start_join();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Sink: count the boots in flash. The PRNG is seeded from the node id, so
+ * a random boot id would come back the same after a reboot. The sink rank
+ * is mixed in: the schedules two sinks start on their own have different
+ * boot ids, so their seqns are never compared. */
+uint8_t next_boot_id(void)
+{
+  uint8_t id = 0;
+  int fd = cfs_open(BOOT_FILE, CFS_READ);
+
+  if (fd >= 0)
+  {
+    if (cfs_read(fd, &id, 1) != 1)
+      id = 0;
+    cfs_close(fd);
+  }
+  if (++id == 0) // 0 is never used
+    id = 1;
+
+  fd = cfs_open(BOOT_FILE, CFS_WRITE);
+  if (fd < 0 || cfs_write(fd, &id, 1) != 1)
+    printf("collect: cannot save the boot id\n");
+  if (fd >= 0)
+    cfs_close(fd);
+  return (uint8_t)(((uint16_t)(id - 1) * NUM_SINKS + conn_ptr->sink) % 255 + 1);
+}
+/*---------------------------------------------------------------------------*/
+int sched_collect_sink_rank(const linkaddr_t *addr)
+{
+  uint8_t i;
+
+  for (i = 0; i < NUM_SINKS; i++)
+    if (linkaddr_cmp(addr, &sinks[i]))
+      return i;
+  return -1;
 }
 /*---------------------------------------------------------------------------*/
-int sched_collect_send(struct sched_collect_conn *c, uint8_t *data, uint8_t len)
+int sched_collect_send(struct sched_collect_conn *c, uint8_t *data, uint8_t len, uint8_t prio)
 {
   /* Store packet in a local buffer to be send during the data collection 
    * time window. If the packet cannot be stored, e.g., because there is
    * a pending packet to be sent, return zero. Otherwise, return non-zero
    * to report operation success. */
 
-  if (c->pending_msg.busy)
-    return 0;
-  else
+  if (prio == SCHED_COLLECT_PRIO_URGENT)
   {
-    // printf("collect: pre copy %d, old mem %d\n", *((uint16_t *) data), *((uint16_t *) c->pending_msg.data));
-    #ifndef CONTIKI_TARGET_SKY
-    c->pending_msg.data = data; // for some reason in Zolertia Firefly I cannot copy the content of data
-    #else
-    memcpy(c->pending_msg.data, data, len);
-    #endif
-    // unsigned short i;
-    // for (i = 0; i < len; i++){
-    //   printf("collect: bef cp %u, %u = %u\n", i, c->pending_msg.data[i], data[i]);
-    //   c->pending_msg.data[i] = data[i];
-    //   printf("collect: aftr cp %u, %u = %u\n", i, c->pending_msg.data[i], data[i]);
-    // }
-    
-    c->pending_msg.len = len;
-    c->pending_msg.busy = true;
-
-    // printf("collect: post copy %d\n", *((uint16_t *) c->pending_msg.data));
+    if (c->urgent_msg.busy || len > SCHED_COLLECT_MAX_PAYLOAD)
+      return 0;
+    memcpy(c->urgent_msg.data, data, len);
+    c->urgent_msg.len = len;
+    c->urgent_msg.busy = true;
+    plan_send(prio);
     return 1;
   }
+
+#if SCHED_COLLECT_CONF_STORE
+  /* Keep the older message in flash rather than refusing the new one
+   * (unless it is on air right now) */
+  if (c->pending_msg.busy && len <= SCHED_COLLECT_MAX_PAYLOAD && tx_fifo == 0 &&
+      msg_store_put(c->pending_msg.data, c->pending_msg.len))
+  {
+    c->pending_msg.busy = false;
+    printf("collect: stored msg, %u in flash\n", msg_store_count());
+  }
+#endif
+  if (c->pending_msg.busy || len > SCHED_COLLECT_MAX_PAYLOAD)
+    return 0;
+
+  memcpy(c->pending_msg.data, data, len);
+  c->pending_msg.len = len;
+  c->pending_msg.busy = true;
+  plan_send(prio);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int sched_collect_command(struct sched_collect_conn *c, const linkaddr_t *dest,
+                          uint8_t type, uint16_t arg)
+{
+  uint8_t i;
+
+  if (c->metric != 0 || type == CMD_NONE)
+    return 0;
+
+  for (i = 0; i < CMD_QUEUE_SIZE; i++)
+  {
+    if (cmd_queue[i].cmd.type == CMD_NONE)
+    {
+      if (++cmd_id == 0) // 0 means no ack
+        cmd_id = 1;
+      cmd_queue[i].cmd.dest = *dest;
+      cmd_queue[i].cmd.id = cmd_id;
+      cmd_queue[i].cmd.type = type;
+      cmd_queue[i].cmd.arg = arg;
+      cmd_queue[i].tries = linkaddr_cmp(dest, &linkaddr_null) ? CMD_BCAST_REPEAT : CMD_MAX_TRIES;
+      printf("collect: queued cmd %u type %u arg %u for %02x:%02x\n",
+             cmd_id, type, arg, dest->u8[0], dest->u8[1]);
+      return 1;
+    }
+  }
+  return 0;
 }
 /*---------------------------------------------------------------------------*/
 /* Routing and synchronization beacons */
 struct beacon_msg
 { // Beacon message structure
   uint16_t seqn;
+  uint8_t boot_id;    // changes at every sink restart
+  uint8_t sink;       // rank of the sink that started the flood
+  uint8_t leader;     // rank of the first sink on the schedule (boot id, seqn) it follows
   uint16_t metric;    // TODO: use LQI?
   clock_time_t delay; // embed the transmission delay to help nodes synchronize
-} __attribute__((packed));
+} __attribute__((packed)); // followed by a struct slot_sched_msg with slot reuse, optionally by a struct sched_collect_cmd
 /* Header structure for data packets */
 struct collect_header
 {
   linkaddr_t source;
   uint8_t hops;
+  uint8_t ack; // id of the last command received by source, 0 if none
+  linkaddr_t parent; // parent of source, for the sink statistics
+  uint8_t prio;      // enum sched_collect_prio
+#if SCHED_COLLECT_CONF_STORE
+  uint8_t count; // messages in the packet, if > 1 each one is prefixed by its length
+#endif
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  uint8_t id;                          // node id of source
+  uint8_t nbrs[SLOT_SCHED_NBR_BYTES];  // neighbors of source, for the slot schedule
+#endif
 } __attribute__((packed));
 /*---------------------------------------------------------------------------*/
 /* Beacon receive callback */
@@ -183,11 +482,38 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
   int16_t rssi;
   struct sched_collect_conn *conn = (struct sched_collect_conn *)(((uint8_t *)bc_conn) - offsetof(struct sched_collect_conn, bc));
 
-  if (packetbuf_datalen() != sizeof(struct beacon_msg))
+  struct sched_collect_cmd cmd = {.type = CMD_NONE};
+
+  if (packetbuf_datalen() == 1 && *(uint8_t *)packetbuf_dataptr() == JOIN_REQUEST)
+  {
+    /* Answer with an early beacon if we are synchronized, can be a parent
+     * and are not about to forward the regular beacon anyway */
+    if (conn->synced && !sink_joining && conn->metric < MAX_HOPS && ctimer_expired(&beacon_ctimer) &&
+        (clock_time_t)(clock_time() - conn->epoch_start) < EPOCH_DURATION - SYNC_WINDOW)
+      ctimer_set(&join_reply_timer, JOIN_REPLY_DELAY, send_join_beacon, NULL);
+    return;
+  }
+
+  if (packetbuf_datalen() == sizeof(struct beacon_msg) + SLOT_SCHED_LEN + sizeof(struct sched_collect_cmd))
+    memcpy(&cmd, (uint8_t *)packetbuf_dataptr() + sizeof(struct beacon_msg) + SLOT_SCHED_LEN, sizeof(cmd));
+  else if (packetbuf_datalen() != sizeof(struct beacon_msg) + SLOT_SCHED_LEN)
   {
     printf("collect: broadcast of wrong size\n");
     return;
   }
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  struct slot_sched_msg sched;
+
+  memcpy(&sched, (uint8_t *)packetbuf_dataptr() + sizeof(struct beacon_msg), sizeof(sched));
+  /* Any audible neighbor constrains the schedule, even below the RSSI threshold */
+  if (sched.id >= 1 && sched.id <= MAX_NODES)
+  {
+    if (conn->metric == 0)
+      slot_sched_heard(sched.id);
+    else
+      NBR_SET(nbr_now, sched.id);
+  }
+#endif
 
   memcpy(&beacon, packetbuf_dataptr(), sizeof(struct beacon_msg));
   rssi = packetbuf_attr(PACKETBUF_ATTR_RSSI);
@@ -197,25 +523,97 @@ void bc_recv(struct broadcast_conn *bc_conn, const linkaddr_t *sender)
          sender->u8[0], sender->u8[1],
          beacon.seqn, beacon.metric, rssi, (u_int16_t)tot_delay, conn->beacon_seqn, conn->metric);
 
+  if (conn->metric == 0) // sinks only follow the schedule of the sinks before them
+  {
+    /* Joining, or the flood of a schedule led by a sink before my leader
+     * (two sinks started on their own), or of a sink before me on my
+     * leader's schedule */
+    if (beacon.sink >= NUM_SINKS ||
+        !(sink_joining || beacon.leader < conn->leader || (beacon.leader == conn->leader && beacon.sink < conn->sink)) ||
+        (beacon.boot_id == conn->boot_id && SEQN_NEWER(conn->beacon_seqn, beacon.seqn)))
+      return;
+    sink_new_epoch = beacon.boot_id != conn->boot_id || SEQN_NEWER(beacon.seqn, conn->beacon_seqn);
+    if (sink_new_epoch)
+      printf("collect: following sink %u, boot id %u seqn %u\n", beacon.sink, beacon.boot_id, beacon.seqn);
+    sink_joining = 0;
+    conn->leader = beacon.leader < conn->sink ? beacon.leader : conn->sink; // the first sink on it leads
+    conn->boot_id = beacon.boot_id;
+    conn->beacon_seqn = beacon.seqn;
+    conn->epoch_start = process_time - beacon.delay;
+    sync_delay = tot_delay + (clock_time() - process_time) * 2 + 1;
+    process_post(&sink_process, collect_event, &sync_delay);
+    return;
+  }
+
   uint16_t my_seqn = conn->beacon_seqn, beacon_seqn = beacon.seqn;
+  bool reboot = conn->synced && beacon.boot_id != conn->boot_id;
+  bool newer = !conn->synced || reboot || SEQN_NEWER(beacon_seqn, my_seqn);
+
+  if (rssi <= RSSI_THRESHOLD) // discard bad RSSI
+    return;
+  /* A sink out of range of mine runs its own schedule: switching to it
+   * and back every epoch would miss both. Only follow another sink on the
+   * same schedule, else wait until mine is lost (MAX_MISSED_EPOCHS). The
+   * exception goes one way: the schedule of a lower ranked leader wins,
+   * and relaying it lets my sink adopt it too. */
+  if (conn->synced && beacon.sink != conn->sink && beacon.leader >= conn->leader &&
+      (beacon.leader != conn->leader || beacon.boot_id != conn->boot_id))
+    return;
+  if (!newer && !(beacon_seqn == my_seqn && beacon.metric < conn->metric)) // stale, or no better metric
+    return;
 
-  if ((beacon_seqn >= my_seqn ||
-       (my_seqn >= 65536 - SEQN_OVERFLOW_TH && beacon_seqn <= (my_seqn + SEQN_OVERFLOW_TH) % 65536)) && // cheap way to handle overflow
-      beacon.metric < conn->metric &&                                                                   // accept better metrics
-      rssi > RSSI_THRESHOLD)                                                                            // discard bad RSSI
+  if (reboot) // fast resync: forget the previous sink epoch right away
+  {
+    printf("collect: sink reboot detected, boot id %u -> %u\n", conn->boot_id, beacon.boot_id);
+    memset(conn->cmd_done, 0, sizeof(conn->cmd_done)); // the sink numbers its commands from 1 again
+  }
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  if (newer) // new epoch
   {
-    conn->metric = beacon.metric + 1;
-    conn->parent = *sender;
-    conn->beacon_seqn = beacon_seqn;
+    memcpy(nbr_prev, nbr_now, sizeof(nbr_now));
+    memset(nbr_now, 0, sizeof(nbr_now));
+    if (sched.id >= 1 && sched.id <= MAX_NODES)
+      NBR_SET(nbr_now, sched.id);
+  }
+  slot_msg = sched;
+  if (node_id >= sched.first + 2 && node_id < sched.first + 2 + SLOT_SCHED_CHUNK &&
+      sched.slots[node_id - sched.first - 2] != my_slot)
+  {
+    my_slot = sched.slots[node_id - sched.first - 2];
+    if (my_slot == SLOT_SCHED_NONE)
+      printf("collect: slot none of %u\n", sched.nslots);
+    else
+      printf("collect: slot %u of %u, turn %u\n", my_slot / SLOT_SCHED_SHARE, sched.nslots, my_slot % SLOT_SCHED_SHARE);
+  }
+#endif
 
-    clock_time_t new_delay = BEACON_FORWARD_DELAY;
-    tot_delay += (clock_time() - process_time) * 2 + 1; // qualitative approx. of the processing delay
-    conn->delay = new_delay + tot_delay;
+  conn->metric = beacon.metric + 1;
+  conn->parent = *sender;
+  conn->beacon_seqn = beacon_seqn;
+  conn->boot_id = beacon.boot_id;
+  conn->sink = beacon.sink;
+  conn->leader = beacon.leader;
+  conn->synced = true;
+  conn->missed = 0;
+  conn->epoch_start = process_time - beacon.delay;
+  ctimer_stop(&sync_timer);
+  ctimer_stop(&join_timer);
+  join_backoff = JOIN_BACKOFF_MIN;
+  conn->cmd = cmd;
+  handle_command(conn);
+
+  clock_time_t new_delay = BEACON_FORWARD_DELAY;
+  tot_delay += (clock_time() - process_time) * 2 + 1; // qualitative approx. of the processing delay
 
-    process_post(&node_process, collect_event, &tot_delay); // set all the timers for collection, sleep and wake up
+  sync_delay = tot_delay;
+  process_post(&node_process, collect_event, &sync_delay); // set all the timers for collection, sleep and wake up
 
-    if (conn->metric < MAX_HOPS) // do not send beacons with metric >= MAX_HOPS
-      ctimer_set(&beacon_ctimer, new_delay, send_beacon, NULL);
+  // do not send beacons with metric >= MAX_HOPS, nor forward early beacons after the flood
+  // (else a forward still pending keeps the delay it was scheduled with)
+  if (conn->metric < MAX_HOPS && tot_delay < MAX_HOPS * SYNCH_SLOT)
+  {
+    conn->delay = new_delay + tot_delay;
+    ctimer_set(&beacon_ctimer, new_delay, send_beacon, NULL);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -236,58 +634,565 @@ void uc_recv(struct unicast_conn *uc_conn, const linkaddr_t *from)
     packetbuf_hdrreduce(sizeof(struct collect_header));
 
     linkaddr_t source = hdr.source;
+    conn_ptr->rx_parent = hdr.parent;
+    conn_ptr->rx_prio = hdr.prio;
+    if (hdr.prio == SCHED_COLLECT_PRIO_URGENT)
+      printf("collect: urgent msg from %02x:%02x, hops %u\n", source.u8[0], source.u8[1], hdr.hops + 1);
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+    if (hdr.hops == 0)
+      slot_sched_heard(hdr.id);
+    slot_sched_report(hdr.id, hdr.nbrs);
+#endif
+    if (hdr.ack != 0)
+    {
+      uint8_t i;
+      linkaddr_t dest;
+      for (i = 0; i < CMD_QUEUE_SIZE; i++)
+      {
+        dest = cmd_queue[i].cmd.dest; // packed member
+        if (cmd_queue[i].cmd.type != CMD_NONE && cmd_queue[i].cmd.id == hdr.ack &&
+            linkaddr_cmp(&dest, &source))
+        {
+          printf("collect: cmd %u acked by %02x:%02x\n", hdr.ack, source.u8[0], source.u8[1]);
+          cmd_queue[i].cmd.type = CMD_NONE;
+        }
+      }
+    }
+#if SCHED_COLLECT_CONF_STORE
+    if (hdr.count > 1)
+    {
+      deliver_batch(&source, hdr.hops + 1);
+      return;
+    }
+#endif
     conn_ptr->callbacks->recv(&source, hdr.hops + 1);
   }
   else
   {
     struct collect_header *hdr_ptr = packetbuf_dataptr();
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+    if (hdr_ptr->hops == 0 && hdr_ptr->id >= 1 && hdr_ptr->id <= MAX_NODES)
+      NBR_SET(nbr_now, hdr_ptr->id);
+#endif
     hdr_ptr->hops++;
+#if SCHED_COLLECT_CONF_STORE
+    if (tx_fifo_len >= TX_FIFO_MAX)
+    {
+      printf("collect: tx queue full, forward dropped\n");
+      return;
+    }
+    tx_fifo_len++;
+#endif
     unicast_send(&conn_ptr->uc, &conn_ptr->parent);
   }
 }
 /*---------------------------------------------------------------------------*/
+#if SCHED_COLLECT_CONF_STORE
+/* Sink: hand each message of a batch packet to the application */
+void deliver_batch(const linkaddr_t *source, uint8_t hops)
+{
+  static uint8_t batch[SCHED_COLLECT_MAX_BATCH];
+  uint16_t len = packetbuf_datalen(), pos = 0;
+  uint8_t n;
+
+  if (len > sizeof(batch))
+    return;
+  memcpy(batch, packetbuf_dataptr(), len);
+
+  while (pos < len)
+  {
+    n = batch[pos++];
+    if (n == 0 || pos + n > len)
+    {
+      printf("collect: malformed batch from %02x:%02x\n", source->u8[0], source->u8[1]);
+      return;
+    }
+    packetbuf_copyfrom(batch + pos, n);
+    conn_ptr->callbacks->recv(source, hops);
+    pos += n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* MAC outcome of a unicast: remove the own batch from the queue once acked */
+void uc_sent(struct unicast_conn *c, int status, int num_tx)
+{
+  bool own = tx_fifo & 1;
+
+  if (tx_fifo_len == 0)
+    return;
+  tx_fifo >>= 1;
+  tx_fifo_len--;
+  if (!own)
+    return;
+
+  if (status != MAC_TX_OK)
+  {
+    printf("collect: msg not acked, kept for the next slot\n");
+    return;
+  }
+  msg_store_commit();
+  if (batch_pending)
+    conn_ptr->pending_msg.busy = false;
+}
+#endif
+/*---------------------------------------------------------------------------*/
 /* Send beacon using the current seqn and metric */
 void send_beacon(void *ptr)
 {
   struct sched_collect_conn *conn = conn_ptr;
   struct beacon_msg beacon = {
       .seqn = conn->beacon_seqn,
+      .boot_id = conn->boot_id,
+      .sink = conn->sink,
+      .leader = conn->leader,
       .metric = conn->metric,
       .delay = conn->delay};
 
   packetbuf_clear();
   packetbuf_copyfrom(&beacon, sizeof(beacon));
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  slot_msg.id = node_id;
+  memcpy((uint8_t *)packetbuf_dataptr() + sizeof(beacon), &slot_msg, sizeof(slot_msg));
+  packetbuf_set_datalen(sizeof(beacon) + sizeof(slot_msg));
+#endif
+  if (conn->cmd.type != CMD_NONE) // piggyback the downlink command
+  {
+    memcpy((uint8_t *)packetbuf_dataptr() + sizeof(beacon) + SLOT_SCHED_LEN, &conn->cmd, sizeof(conn->cmd));
+    packetbuf_set_datalen(sizeof(beacon) + SLOT_SCHED_LEN + sizeof(conn->cmd));
+  }
   printf("collect: sending beacon: seqn %d metric %d\n", conn->beacon_seqn, conn->metric);
   broadcast_send(&conn->bc);
 }
 /*---------------------------------------------------------------------------*/
 /* Send collect msg with unicast */
-void send_collect()
+void send_collect(void *p)
 {
+  /* No beacon in the last epoch: the route to the sink may be gone, hold
+   * the packets (with the always-on strategies, the slots need a beacon) */
+  if (!conn_ptr->synced || conn_ptr->missed != 0)
+    return;
+#if SCHED_COLLECT_CONF_STORE
+  if (linkaddr_cmp(&conn_ptr->parent, &linkaddr_null) || tx_fifo != 0 || tx_fifo_len >= TX_FIFO_MAX)
+    return;
+#else
   if (!conn_ptr->pending_msg.busy || linkaddr_cmp(&conn_ptr->parent, &linkaddr_null))
     return;
+#endif
 
   struct msg_buffer *msg = &conn_ptr->pending_msg;
-  struct collect_header hdr = {.source = linkaddr_node_addr, .hops = 0};
+  struct collect_header hdr;
 
-  // add data to buffer
+  init_header(&hdr, SCHED_COLLECT_PRIO_NORMAL);
   packetbuf_clear();
+#if SCHED_COLLECT_CONF_STORE
+  /* Oldest stored messages first, then the pending one if it still fits */
+  uint8_t *batch = packetbuf_dataptr();
+  uint8_t count, len = msg_store_batch(batch, SCHED_COLLECT_MAX_BATCH, &count);
+
+  batch_pending = msg->busy && len + 1 + msg->len <= SCHED_COLLECT_MAX_BATCH;
+  if (batch_pending)
+  {
+    batch[len] = msg->len;
+    memcpy(batch + len + 1, msg->data, msg->len);
+    len += 1 + msg->len;
+    count++;
+  }
+  if (count == 0)
+    return;
+  if (count == 1) // a single message is sent as is
+    memmove(batch, batch + 1, --len);
+  packetbuf_set_datalen(len);
+  hdr.count = count;
+#else
+  // add data to buffer
   memcpy(packetbuf_dataptr(), msg->data, msg->len);
   packetbuf_set_datalen(msg->len);
+#endif
 
   // add header
   packetbuf_hdralloc(sizeof(struct collect_header));
   memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct collect_header));
 
   // send packet
+  if (SLOTTED)
+    set_channel(SLOT_CHANNEL(conn_ptr->beacon_seqn, MY_SLOT));
+#if SCHED_COLLECT_CONF_STORE
+  if (count > 1)
+    printf("collect: %u sending batch of %u msgs, %u in flash\n", node_id, count, msg_store_count());
+  else
+    printf("collect: %u sending msg\n", node_id);
+  tx_fifo |= 1 << tx_fifo_len++; // the buffer is freed when acked
+  unicast_send(&conn_ptr->uc, &conn_ptr->parent);
+#else
   printf("collect: %u sending msg\n", node_id);
   unicast_send(&conn_ptr->uc, &conn_ptr->parent);
   conn_ptr->pending_msg.busy = false; // free the buffer
+#endif
+  conn_ptr->cmd_ack = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Send the urgent msg, if any, in the emergency window: the relays forward
+ * it right away, like in the collection slots */
+void send_urgent(void *p)
+{
+  struct msg_buffer *msg = &conn_ptr->urgent_msg;
+  struct collect_header hdr;
+
+  if (!msg->busy || linkaddr_cmp(&conn_ptr->parent, &linkaddr_null) ||
+      !conn_ptr->synced || conn_ptr->missed != 0)
+    return;
+#if SCHED_COLLECT_CONF_STORE
+  if (tx_fifo_len >= TX_FIFO_MAX) // kept for the next window
+    return;
+#endif
+
+  init_header(&hdr, SCHED_COLLECT_PRIO_URGENT);
+  packetbuf_clear();
+  memcpy(packetbuf_dataptr(), msg->data, msg->len);
+  packetbuf_set_datalen(msg->len);
+  packetbuf_hdralloc(sizeof(struct collect_header));
+  memcpy(packetbuf_hdrptr(), &hdr, sizeof(struct collect_header));
+
+  printf("collect: %u sending urgent msg\n", node_id);
+#if SCHED_COLLECT_CONF_STORE
+  tx_fifo_len++; // not the own batch: nothing to commit
+#endif
+  unicast_send(&conn_ptr->uc, &conn_ptr->parent);
+  msg->busy = false;
+  conn_ptr->cmd_ack = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Header of a packet of this node */
+void init_header(struct collect_header *hdr, uint8_t prio)
+{
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  uint8_t i;
+
+  hdr->id = node_id;
+  for (i = 0; i < SLOT_SCHED_NBR_BYTES; i++)
+    hdr->nbrs[i] = nbr_now[i] | nbr_prev[i];
+#endif
+#if SCHED_COLLECT_CONF_STORE
+  hdr->count = 1;
+#endif
+  hdr->source = linkaddr_node_addr;
+  hdr->hops = 0;
+  hdr->ack = conn_ptr->cmd_ack;
+  hdr->parent = conn_ptr->parent;
+  hdr->prio = prio;
+}
+/*---------------------------------------------------------------------------*/
+/* Transmission strategies: the timers of the epoch a node sets when it
+ * accepts a beacon, tot_delay ticks after the epoch start, and those it
+ * sets when the application queues a packet */
+#if SLOTTED
+void plan_epoch(clock_time_t tot_delay)
+{
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+  /* The nodes of a slot take turns in it, by rank. Without a slot, use
+   * the join slot of my id or, once the schedule settled, a shared one at
+   * random. */
+  if (my_slot < slot_msg.nslots * SLOT_SCHED_SHARE)
+  {
+    tx_slot = my_slot / SLOT_SCHED_SHARE;
+    tx_rank = my_slot % SLOT_SCHED_SHARE;
+  }
+  else
+  {
+    tx_slot = slot_msg.nslots + (slot_msg.njoin >= MAX_NODES - 1 ? node_id - 2 : random_rand() % slot_msg.njoin);
+    tx_rank = random_rand() % SLOT_SCHED_SHARE;
+  }
+#endif
+  /* An early beacon (join reply) may come after my slot or the window */
+  if (tot_delay < COLLECT_OFFSET)
+    etimer_set(&collect_timer, COLLECT_OFFSET + SLOT_GUARD + SLOT_JITTER - tot_delay);
+  else
+    etimer_stop(&collect_timer);
+  ctimer_set(&slot_timer, tot_delay < SLOTS_START ? SLOTS_START - tot_delay : 0, slot_cb, NULL);
+  if (tot_delay < MAX_HOPS * SYNCH_SLOT)
+    ctimer_set(&urgent_timer, MAX_HOPS * SYNCH_SLOT + EMERGENCY_JITTER - tot_delay, send_urgent, NULL);
+  ctimer_set(&sleep_timer, tot_delay < WINDOW_END ? WINDOW_END - tot_delay : 0,
+             RESCANNING ? rescan_cb : sleep_cb, NULL);
+  plan_emergency(tot_delay);
+  ctimer_set(&wakeup_timer, EPOCH_DURATION - tot_delay - GUARD_TIME, wakeup_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void plan_send(uint8_t prio)
+{
+  /* Sent in the slot of the next epoch, or in the next emergency window */
+}
+#else
+void plan_epoch(clock_time_t tot_delay)
+{
+  bool held = conn_ptr->pending_msg.busy;
+
+#if SCHED_COLLECT_CONF_STORE
+  held = held || msg_store_count() > 0;
+#endif
+  /* The radio stays on, the epochs only matter for the beacons. Send what
+   * was held back while the node had no route. */
+  if (held && ctimer_expired(&send_timer))
+    ctimer_set(&send_timer, SEND_DELAY, send_collect, NULL);
+  if (conn_ptr->urgent_msg.busy && ctimer_expired(&urgent_timer))
+    ctimer_set(&urgent_timer, EMERGENCY_JITTER, send_urgent, NULL);
+  ctimer_set(&wakeup_timer, EPOCH_DURATION - tot_delay - GUARD_TIME, wakeup_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void plan_send(uint8_t prio)
+{
+  if (prio == SCHED_COLLECT_PRIO_URGENT)
+    ctimer_set(&urgent_timer, EMERGENCY_JITTER, send_urgent, NULL);
+  else
+    ctimer_set(&send_timer, SEND_DELAY, send_collect, NULL);
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/* Set the timer of the first emergency wake-up after elapsed ticks from
+ * the epoch start, if any is left in this epoch: it must end before the
+ * wake up for the next flood (with many hops the last ones do not fit) */
+void plan_emergency(clock_time_t elapsed)
+{
+  uint8_t k;
+
+  for (k = 1; k <= EMERGENCY_WAKEUPS; k++)
+  {
+    if (EMERGENCY_AT(k) + EMERGENCY_WINDOW + EMERGENCY_GUARD > EPOCH_DURATION - GUARD_TIME)
+      break;
+    if (EMERGENCY_AT(k) > elapsed + EMERGENCY_GUARD && EMERGENCY_AT(k) >= WINDOW_END + EMERGENCY_GUARD)
+    {
+      ctimer_set(&emergency_timer, EMERGENCY_AT(k) - EMERGENCY_GUARD - elapsed, emergency_cb, NULL);
+      return;
+    }
+  }
+  ctimer_stop(&emergency_timer);
+}
+/*---------------------------------------------------------------------------*/
+/* Emergency wake-up: every node listens on the channel of the flood, the
+ * ones with an urgent msg send it once the late clocks woke up too */
+void emergency_cb(void *p)
+{
+  set_channel(EPOCH_CHANNEL);
+  NETSTACK_MAC.on();
+  if (conn_ptr->urgent_msg.busy)
+    ctimer_set(&urgent_timer, EMERGENCY_GUARD + EMERGENCY_JITTER, send_urgent, NULL);
+  ctimer_set(&emergency_timer, EMERGENCY_WINDOW + 2 * EMERGENCY_GUARD, emergency_end_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void emergency_end_cb(void *p)
+{
+  /* A sync or join window may have opened meanwhile (clock drift, sink
+   * lost): it keeps the radio */
+  if (conn_ptr->synced && ctimer_expired(&sync_timer) && !sink_joining && !RESCANNING)
+    NETSTACK_MAC.off(false);
+  plan_emergency(clock_time() - conn_ptr->epoch_start);
+}
+/*---------------------------------------------------------------------------*/
+/* End of the window while RESCANNING: stay on, on the next channel every
+ * time, for the floods of a lower ranked leader */
+void rescan_cb(void *p)
+{
+  set_channel(hop_channels[join_channel++ % HOP_CHANNELS]);
+}
+/*---------------------------------------------------------------------------*/
+/* Sink: set the timers of the epoch, elapsed ticks after its beginning,
+ * and with flood send its beacon. The first sink beacons right away, the
+ * others after a random delay. */
+void sink_epoch(clock_time_t elapsed, bool flood)
+{
+  clock_time_t wait = conn_ptr->sink == 0 ? 0 : SINK_BEACON_DELAY;
+
+  set_channel(EPOCH_CHANNEL);
+  if (flood && elapsed < SYNCH_SLOT) // else too late to start a flood
+  {
+    select_command(conn_ptr);
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+    select_slots(conn_ptr->beacon_seqn);
+#endif
+    conn_ptr->delay = elapsed + wait;
+    if (wait == 0)
+      send_beacon(NULL);
+    else
+      ctimer_set(&beacon_ctimer, wait, send_beacon, NULL);
+  }
+
+  etimer_set(&beacon_etimer, EPOCH_DURATION - elapsed);
+  if (!SLOTTED) // the radio stays on
+    return;
+  if (elapsed < SLOTS_START)
+    etimer_set(&collect_timer, SLOTS_START - elapsed);
+  ctimer_set(&sleep_timer, elapsed < WINDOW_END ? WINDOW_END - elapsed : 0,
+             RESCANNING ? rescan_cb : sleep_cb, NULL);
+  plan_emergency(elapsed);
+}
+/*---------------------------------------------------------------------------*/
+/* Sink: pick the command to piggyback on the next beacon */
+void select_command(struct sched_collect_conn *conn)
+{
+  uint8_t i, idx;
+
+  conn->cmd.type = CMD_NONE;
+  for (i = 0; i < CMD_QUEUE_SIZE; i++)
+  {
+    idx = (cmd_next + i) % CMD_QUEUE_SIZE;
+    if (cmd_queue[idx].cmd.type != CMD_NONE)
+    {
+      conn->cmd = cmd_queue[idx].cmd;
+      if (--cmd_queue[idx].tries == 0) // last attempt, free the entry
+        cmd_queue[idx].cmd.type = CMD_NONE;
+      cmd_next = idx + 1;
+      return;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+/* Sink: update the slot schedule and pick the part of it to put on the
+ * next beacon: the chunks with changed entries first, else the chunks
+ * take turns epoch after epoch */
+void select_slots(uint16_t seqn)
+{
+  const uint8_t chunks = (MAX_NODES - 1 + SLOT_SCHED_CHUNK - 1) / SLOT_SCHED_CHUNK;
+  uint8_t i, id;
+
+  slot_msg.nslots = slot_sched_update(seqn % SLOT_SCHED_PERIOD == 0);
+  slot_msg.njoin = slot_sched_join_slots();
+  id = slot_sched_changed();
+  if (id != 0)
+    slot_msg.first = (id - 2) / SLOT_SCHED_CHUNK * SLOT_SCHED_CHUNK;
+  else
+    slot_msg.first = (seqn % chunks) * SLOT_SCHED_CHUNK;
+  for (i = 0; i < SLOT_SCHED_CHUNK; i++)
+    slot_msg.slots[i] = slot_sched_get(slot_msg.first + i + 2);
+}
+#endif
+/*---------------------------------------------------------------------------*/
+/* Node: execute the command of the accepted beacon if it is for us */
+void handle_command(struct sched_collect_conn *conn)
+{
+  linkaddr_t dest = conn->cmd.dest; // packed member
+  bool bcast = linkaddr_cmp(&dest, &linkaddr_null);
+  uint8_t i;
+
+  if (conn->cmd.type == CMD_NONE ||
+      !(bcast || linkaddr_cmp(&dest, &linkaddr_node_addr)))
+    return;
+
+  if (!bcast)
+    conn->cmd_ack = conn->cmd.id; // (re)ack even duplicates, the ack may be lost
+
+  for (i = 0; i < CMD_HISTORY; i++)
+    if (conn->cmd_done[i] == conn->cmd.id)
+      return;
+  conn->cmd_done[conn->cmd_done_next] = conn->cmd.id;
+  conn->cmd_done_next = (conn->cmd_done_next + 1) % CMD_HISTORY;
+
+  printf("collect: recv cmd %u type %u arg %u\n", conn->cmd.id, conn->cmd.type, conn->cmd.arg);
+  if (conn->callbacks != NULL && conn->callbacks->cmd != NULL)
+    conn->callbacks->cmd(&conn->cmd);
 }
 /*---------------------------------------------------------------------------*/
 /* wake up callback */
 void wakeup_cb(void *p)
 {
+  set_channel(BEACON_CHANNEL(conn_ptr->boot_id, conn_ptr->beacon_seqn + 1 + conn_ptr->missed)); // coasting: epochs missed
   NETSTACK_MAC.on();
   conn_ptr->metric = 65535;
-}
\ No newline at end of file
+  ctimer_set(&sync_timer, SYNC_WINDOW, sync_timeout_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* No beacon accepted in the listen window after wake up */
+void sync_timeout_cb(void *p)
+{
+  if (++conn_ptr->missed >= MAX_MISSED_EPOCHS)
+  {
+    /* Drop the sync state so that any beacon is accepted again
+     * (e.g. the sink restarted with the same boot id) */
+    printf("collect: lost sync after %u epochs\n", conn_ptr->missed);
+    start_join();
+    return;
+  }
+
+  /* Coast on the previous schedule: sleep until the next epoch */
+  printf("collect: missed beacon %u\n", conn_ptr->missed);
+  if (SLOTTED)
+    NETSTACK_MAC.off(false);
+  ctimer_set(&wakeup_timer, EPOCH_DURATION - SYNC_WINDOW, wakeup_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+/* Enter join mode: scan for beacons with short listen windows */
+void start_join(void)
+{
+  conn_ptr->synced = false;
+  join_backoff = JOIN_BACKOFF_MIN;
+  join_listen_cb(NULL);
+}
+/*---------------------------------------------------------------------------*/
+void join_listen_cb(void *p)
+{
+  if (conn_ptr->synced)
+    return;
+
+  set_channel(hop_channels[join_channel++ % HOP_CHANNELS]); // the floods hop, so does the scan
+  NETSTACK_MAC.on();
+#if SCHED_COLLECT_CONF_JOIN_REQUEST
+  uint8_t req = JOIN_REQUEST;
+  packetbuf_clear();
+  packetbuf_copyfrom(&req, sizeof(req));
+  broadcast_send(&conn_ptr->bc);
+#endif
+  ctimer_set(&join_timer, JOIN_LISTEN, join_sleep_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void join_sleep_cb(void *p)
+{
+  if (conn_ptr->synced)
+    return;
+
+  if (SLOTTED)
+    NETSTACK_MAC.off(false);
+  /* Random jitter so that the scan does not lock to the epoch period */
+  ctimer_set(&join_timer, join_backoff + random_rand() % JOIN_LISTEN, join_listen_cb, NULL);
+  printf("collect: join scan, next in %u ticks\n", (unsigned)join_backoff);
+  join_backoff *= 2;
+  if (join_backoff > JOIN_BACKOFF_MAX)
+    join_backoff = JOIN_BACKOFF_MAX;
+}
+/*---------------------------------------------------------------------------*/
+/* Early beacon for a joining neighbor, delay is the time since epoch start */
+void send_join_beacon(void *p)
+{
+  clock_time_t delay = conn_ptr->delay;
+
+  conn_ptr->delay = clock_time() - conn_ptr->epoch_start;
+  send_beacon(NULL);
+  conn_ptr->delay = delay; // the forward of a better beacon may be pending
+}
+/*---------------------------------------------------------------------------*/
+/* Collection window: follow the channel of the current slot */
+void slot_cb(void *p)
+{
+  clock_time_t now = clock_time() - conn_ptr->epoch_start;
+  uint16_t slot;
+
+  if (HOP_CHANNELS == 1)
+    return;
+  if (now < SLOTS_START) // still in the flood or in the emergency window
+  {
+    ctimer_set(&slot_timer, SLOTS_START - now, slot_cb, NULL);
+    return;
+  }
+  slot = (now - SLOTS_START) / SLOT_TIME;
+  if (slot >= WINDOW_SLOTS) // end of the window
+    return;
+
+  set_channel(SLOT_CHANNEL(conn_ptr->beacon_seqn, slot));
+  if (!SCHED_COLLECT_CONF_SLOT_HOPPING) // one channel for the whole window
+    return;
+  ctimer_set(&slot_timer, SLOTS_START + (slot + 1) * SLOT_TIME - now, slot_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void set_channel(uint8_t channel)
+{
+  if (HOP_CHANNELS > 1)
+    NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL, channel);
+}
@@ -9,10 +9,12 @@
 /*---------------------------------------------------------------------------*/
 #define EPOCH_DURATION (30 * CLOCK_SECOND)  // collect every 30 seconds
 /*---------------------------------------------------------------------------*/
-#ifndef CONTIKI_TARGET_SKY
-/* Testbed experiments with Zoul Firefly platform */
+#if defined(MAX_HOPS) && defined(MAX_NODES)
+/* Set by the build, e.g. large networks in the host simulator */
+#elif !defined(CONTIKI_TARGET_SKY)
+/* Testbed experiments with Zoul Firefly platform, nodes 1-36 */
 #define MAX_HOPS 4
-#define MAX_NODES 35
+#define MAX_NODES 36
 #else
 /* Cooja experiments with Tmote Sky platform */
 #define MAX_HOPS 3
@@ -21,15 +23,145 @@
 /*---------------------------------------------------------------------------*/
 #define COLLECT_CHANNEL 0xAA
 /*---------------------------------------------------------------------------*/
+/* Transmission strategy: when nodes send their packets. All of them use the
+ * beacon flood for routing, synchronization and downlink commands.
+ *  - SCHED_COLLECT_TDMA: one collection slot per node after the flood, the
+ *    radio sleeps for the rest of the epoch
+ *  - SCHED_COLLECT_RND_DELAY: a random delay in [2 s, EPOCH_DURATION / 2)
+ *    after the packet is queued, radio always on
+ *  - SCHED_COLLECT_CSMA: right away, left to the CSMA of the MAC, radio
+ *    always on (also a fallback for deployments where TDMA cannot sync) */
+#define SCHED_COLLECT_TDMA 0
+#define SCHED_COLLECT_RND_DELAY 1
+#define SCHED_COLLECT_CSMA 2
+#ifndef SCHED_COLLECT_CONF_STRATEGY
+#define SCHED_COLLECT_CONF_STRATEGY SCHED_COLLECT_TDMA
+#endif
+/*---------------------------------------------------------------------------*/
+/* Sinks, in order of precedence. All sinks flood beacons in the same
+ * epochs with the same seqn: a sink follows boot id, seqn and epoch
+ * timing of the sinks before it in the list whenever it hears them
+ * (directly or through the flood of a node), and runs on its own when
+ * they are gone. Nodes send to the nearest sink by metric and fail over
+ * to another sink on the same schedule with the next beacon; a sink that
+ * runs its own schedule only after losing sync (MAX_MISSED_EPOCHS).
+ * Sinks that booted apart and started their own schedules merge: the
+ * later one listens between its windows, and its nodes for a whole epoch
+ * every SCHED_COLLECT_CONF_RESCAN_EPOCHS, until they hear the schedule of
+ * the earlier sink.
+ * There is no backbone: a command is queued and acked only at the sink
+ * that got it, an ack that reaches another sink is lost and the command
+ * goes out again until CMD_MAX_TRIES. */
+#ifndef SCHED_COLLECT_CONF_RESCAN_EPOCHS
+#define SCHED_COLLECT_CONF_RESCAN_EPOCHS 32 // a split schedule: its nodes listen a whole epoch in N
+#endif
+#ifdef SCHED_COLLECT_CONF_SINKS
+#define SCHED_COLLECT_SINKS SCHED_COLLECT_CONF_SINKS
+#elif !defined(CONTIKI_TARGET_SKY)
+#define SCHED_COLLECT_SINKS { {{0xF7, 0x9C}} } // testbed: Firefly node 1
+#else
+#define SCHED_COLLECT_SINKS { {{0x01, 0x00}} } // Cooja: Sky node 1
+#endif
+/*---------------------------------------------------------------------------*/
+/* Radio channel hopping. The beacon flood of epoch seqn hops too: it
+ * visits every channel of SCHED_COLLECT_CHANNELS once in each block of N
+ * epochs, in an order mixed from the sink boot id, so one jammed channel
+ * costs one flood in N. Synchronized nodes know the channel of the next
+ * flood; unsynchronized ones (and a sink after a reboot) scan the
+ * channels in turn. With slot hopping, collection slot s of epoch seqn
+ * uses SCHED_COLLECT_CHANNELS[(seqn + 1 + s) % N], otherwise the whole
+ * collection window of the epoch uses SCHED_COLLECT_CHANNELS[seqn % N].
+ * A single channel, or an always-on strategy, disables hopping. */
+#ifdef SCHED_COLLECT_CONF_CHANNELS
+#define SCHED_COLLECT_CHANNELS SCHED_COLLECT_CONF_CHANNELS
+#else
+#define SCHED_COLLECT_CHANNELS { 26 }
+#endif
+#ifndef SCHED_COLLECT_CONF_SLOT_HOPPING
+#define SCHED_COLLECT_CONF_SLOT_HOPPING 1
+#endif
+/*---------------------------------------------------------------------------*/
+/* Join mode: unsynchronized nodes broadcast a join request at the start of
+ * each scan window so that an awake neighbor answers with an early beacon */
+#ifndef SCHED_COLLECT_CONF_JOIN_REQUEST
+#define SCHED_COLLECT_CONF_JOIN_REQUEST 1
+#endif
+/* Store-and-forward: messages that cannot be sent (no parent, or the
+ * unicast is not acked) are kept in a Coffee queue (msg_store.h) and
+ * drained in batch packets once the node is connected again.
+ * Needs Coffee, see project-conf.h. */
+#ifndef SCHED_COLLECT_CONF_STORE
+#define SCHED_COLLECT_CONF_STORE 0
+#endif
+/* Spatial slot reuse: instead of one slot per node id, the sink gives the
+ * same collection slot to nodes more than two hops apart (slot_sched.h),
+ * from the neighbors each node reports in its packets. The schedule rides
+ * on the beacons; nodes without a slot yet send in a few shared slots at
+ * the end of the window. */
+#ifndef SCHED_COLLECT_CONF_SLOT_REUSE
+#define SCHED_COLLECT_CONF_SLOT_REUSE 0
+#endif
+/* Priority classes of sched_collect_send(). Normal packets wait for the
+ * collection slot of their source. Urgent ones (alarms) go out in the next
+ * emergency window, a short contention window where every node listens and
+ * relays them at once: one right after the beacon flood and
+ * SCHED_COLLECT_CONF_EMERGENCY_WAKEUPS more spread over the sleep time of
+ * the epoch, so an alarm waits a fraction of the epoch instead of queuing
+ * behind the regular traffic. Each wake-up costs about two collection slots
+ * of radio time. The always-on strategies send them right away. */
+#ifndef SCHED_COLLECT_CONF_EMERGENCY_WAKEUPS
+#define SCHED_COLLECT_CONF_EMERGENCY_WAKEUPS 3
+#endif
+enum sched_collect_prio {
+  SCHED_COLLECT_PRIO_NORMAL = 0,
+  SCHED_COLLECT_PRIO_URGENT
+};
+/* Static RAM budget in bytes of the tables sized by the configuration
+ * (command queue, msg buffers, slot scheduler, neighbor maps, store index
+ * and sink statistics), checked at compile time: on the Sky they share
+ * 10 KB with Contiki, the process stacks and packetbuf. make footprint
+ * reports the RAM and ROM of the whole image per module. */
+#ifndef SCHED_COLLECT_CONF_RAM_BUDGET
+#ifdef CONTIKI_TARGET_SKY
+#define SCHED_COLLECT_CONF_RAM_BUDGET 1024
+#else
+#define SCHED_COLLECT_CONF_RAM_BUDGET 4096
+#endif
+#endif
+#define SCHED_COLLECT_MAX_PAYLOAD 64 // max application payload in bytes
+#define SCHED_COLLECT_MAX_BATCH 80   // max payload of a batch packet in bytes
+/*---------------------------------------------------------------------------*/
+/* Downlink commands, piggybacked on the beacon flood */
+#define CMD_QUEUE_SIZE 4    // commands queued at the sink
+#define CMD_MAX_TRIES 5     // beacons carrying a unicast command before giving up
+#define CMD_BCAST_REPEAT 3  // beacons carrying a broadcast command (not acked)
+/* Command ids a node remembers as executed: the sink carries its queued
+ * commands in turn, so a command comes back after at most
+ * CMD_QUEUE_SIZE - 1 others, CMD_MAX_TRIES times */
+#define CMD_HISTORY ((CMD_MAX_TRIES - 1) * (CMD_QUEUE_SIZE - 1) + 1)
+enum sched_collect_cmd_type {
+  CMD_NONE = 0,
+  CMD_ACTUATE,   // arg: application defined actuator value
+  CMD_SET_RATE,  // arg: new reporting period in seconds
+  CMD_RESEND     // arg: application seqn to be sent again
+};
+struct sched_collect_cmd {
+  linkaddr_t dest;  // linkaddr_null for broadcast
+  uint8_t id;       // non-zero, echoed back in the uplink ack
+  uint8_t type;
+  uint16_t arg;
+} __attribute__((packed));
+/*---------------------------------------------------------------------------*/
 /* Callback structure */
 struct sched_collect_callbacks {
   void (* recv)(const linkaddr_t *originator, uint8_t hops);
+  void (* cmd)(const struct sched_collect_cmd *cmd); // may be NULL
 };
 /*---------------------------------------------------------------------------*/
 /* Connection object */
 struct msg_buffer
 {
-  uint8_t *data;
+  uint8_t data[SCHED_COLLECT_MAX_PAYLOAD];
   uint8_t len;
   bool busy;
 };
@@ -38,17 +170,31 @@ struct sched_collect_conn {
   struct unicast_conn uc;
   const struct sched_collect_callbacks* callbacks;
   struct msg_buffer pending_msg;
+  struct msg_buffer urgent_msg; // SCHED_COLLECT_PRIO_URGENT, sent in the emergency window
   linkaddr_t parent;
   uint16_t metric;
   uint16_t beacon_seqn;
+  uint8_t boot_id;  // sink boot epoch the beacon_seqn refers to
+  uint8_t sink;     // rank of the sink (own rank, or that of the accepted beacon)
+  uint8_t leader;   // rank of the sink whose schedule is followed
+  bool synced;      // false until the first beacon (or after losing sync)
+  uint8_t missed;   // consecutive epochs without an accepted beacon
+  clock_time_t epoch_start; // local time the current epoch started
+  linkaddr_t rx_parent;     // sink: first hop of the packet being delivered
+  uint8_t rx_prio;          // sink: priority of the packet being delivered
   clock_time_t delay;
+  struct sched_collect_cmd cmd; // command carried by the current beacon
+  uint8_t cmd_done[CMD_HISTORY]; // last executed commands (duplicate filter)
+  uint8_t cmd_done_next;         // next entry of cmd_done to overwrite
+  uint8_t cmd_ack;              // command id to ack in the next uplink
   // you can add other useful variables to the object
 };
 /*---------------------------------------------------------------------------*/
 /* Initialize a collect connection
  *  - conn -- a pointer to a connection object
  *  - channels -- starting channel C (the collect uses two: C and C+1)
- *  - is_sink -- initialize in either sink or router mode
+ *  - is_sink -- initialize in either sink or router mode (a sink must be
+ *               in SCHED_COLLECT_SINKS)
  *  - callbacks -- a pointer to the callback structure */
 void sched_collect_open(
     struct sched_collect_conn* conn,
@@ -56,18 +202,45 @@ void sched_collect_open(
     bool is_sink,
     const struct sched_collect_callbacks *callbacks);
 /*---------------------------------------------------------------------------*/
+/* Rank of addr in SCHED_COLLECT_SINKS, -1 if it is not a sink */
+int sched_collect_sink_rank(const linkaddr_t *addr);
+/*---------------------------------------------------------------------------*/
 /* Send packet to the sink 
  * Parameters:
  *  - conn -- a pointer to a connection object
  *  - data -- a pointer to the data packet to be sent
  *  - len  -- data length to be send in bytes
+ *  - prio -- priority class (enum sched_collect_prio)
  * 
- * Returns zero if the packet cannot be stored nor sent.
- * Non-zero otherwise.
+ * Returns zero if the packet cannot be stored nor sent (buffer busy or
+ * len > SCHED_COLLECT_MAX_PAYLOAD). Non-zero otherwise.
+ * With SCHED_COLLECT_CONF_STORE a busy buffer is moved to flash instead.
+ * Urgent packets have a buffer of their own and are never stored.
  */
 int sched_collect_send(
     struct sched_collect_conn *c,
     uint8_t *data,
-    uint8_t len);
+    uint8_t len,
+    uint8_t prio);
+/*---------------------------------------------------------------------------*/
+/* Queue a downlink command at the sink
+ * Parameters:
+ *  - conn -- a pointer to a sink connection object
+ *  - dest -- destination node, linkaddr_null to address all nodes
+ *  - type -- command type (enum sched_collect_cmd_type)
+ *  - arg  -- command argument
+ *
+ * The command rides on the next beacons until the destination acks it
+ * in its collection slot (CMD_MAX_TRIES beacons at most). Broadcast
+ * commands are repeated CMD_BCAST_REPEAT times and are not acked.
+ *
+ * Returns zero if the queue is full or conn is not a sink.
+ * Non-zero otherwise.
+ */
+int sched_collect_command(
+    struct sched_collect_conn *c,
+    const linkaddr_t *dest,
+    uint8_t type,
+    uint16_t arg);
 /*---------------------------------------------------------------------------*/
 #endif //SCHED_COLLECT_H
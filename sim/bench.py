@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+# Performance benchmarks of sched_collect on the host simulator.
+#
+# Runs the scenarios of bench.json (each one with its own build of the
+# firmware), checks their gates on PDR, duty cycle, sync error and latency, and
+# appends the results to a history file tagged with the git commit, so that
+# a regression can be tracked down with
+#
+#   git bisect run sim/bench.py
+#
+# Exits with 1 if a gate failed, with 125 if the firmware or the simulator
+# does not build (git bisect skips the commit). Through make the exit code
+# is lost: make bench exits with 2 either way.
+
+import os
+import sys
+import json
+import time
+import argparse
+import subprocess
+import tempfile
+
+simdir = os.path.dirname(os.path.abspath(__file__))
+exit_untestable = 125 # git bisect run skips the commit
+
+
+def git_commit():
+	try:
+		commit = subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD'],
+			cwd=simdir, stderr=subprocess.DEVNULL).decode().strip()
+		dirty = subprocess.call(['git', 'diff', '--quiet', 'HEAD', '--'],
+			cwd=simdir, stderr=subprocess.DEVNULL) != 0
+	except (OSError, subprocess.CalledProcessError):
+		return "unknown"
+	return commit + ("-dirty" if dirty else "")
+
+
+def build(flags):
+	ret = subprocess.call(['make', '-s', '--no-print-directory',
+		'-j{}'.format(os.cpu_count() or 1)] + flags, cwd=simdir)
+	if ret != 0:
+		print("bench: build failed ({})".format(" ".join(flags) or "default"), file=sys.stderr)
+		sys.exit(exit_untestable)
+
+
+def run(scenario):
+	with tempfile.NamedTemporaryFile(suffix='.json') as f:
+		cmd = ['./sched-collect-sim', '--quiet', '--json', f.name] + scenario['args']
+		ret = subprocess.call(cmd, cwd=simdir, stderr=subprocess.DEVNULL)
+		if ret not in (0, 1):
+			sys.exit("bench: {} failed: {}".format(scenario['name'], " ".join(cmd)))
+		return json.load(open(f.name))
+
+
+def check(results, gates):
+	"""Return the list of the gates that failed: min and max bound a metric,
+	below names another metric it must stay under"""
+	failed = []
+	for metric, gate in sorted(gates.items()):
+		value = results[metric]
+		if 'min' in gate and value < gate['min']:
+			failed.append("{} {:.3f} < {}".format(metric, value, gate['min']))
+		if 'max' in gate and value > gate['max']:
+			failed.append("{} {:.3f} > {}".format(metric, value, gate['max']))
+		if 'below' in gate and value >= results[gate['below']]:
+			failed.append("{} {:.3f} >= {} {:.3f}".format(metric, value,
+				gate['below'], results[gate['below']]))
+	return failed
+
+
+def last_results(history, name):
+	"""Results of the previous run of a scenario in the history file"""
+	last = None
+	if os.path.exists(history):
+		with open(history, 'r') as f:
+			for line in f:
+				try:
+					rec = json.loads(line)
+				except ValueError:
+					continue
+				if rec.get('scenario') == name:
+					last = rec
+	return last
+
+
+def parse_args():
+	parser = argparse.ArgumentParser()
+	parser.add_argument('--scenarios', default=os.path.join(simdir, 'bench.json'),
+		help="scenario file (default bench.json)")
+	parser.add_argument('--history', default=os.path.join(simdir, 'bench-history.jsonl'),
+		help="results history, one JSON record per line (default bench-history.jsonl)")
+	parser.add_argument('--no-history', action='store_true',
+		help="do not record the results")
+	parser.add_argument('--only', action='append', metavar='NAME',
+		help="run this scenario only (repeatable)")
+	return parser.parse_args()
+
+
+if __name__ == '__main__':
+	args = parse_args()
+	scenarios = json.load(open(args.scenarios))['scenarios']
+	if args.only:
+		scenarios = [s for s in scenarios if s['name'] in args.only]
+	commit = git_commit()
+	nfailed = 0
+
+	print("{:<14} {:>8} {:>8} {:>8} {:>10}  {}".format(
+		"scenario", "PDR %", "DC avg", "DC max", "sync ms", "result"))
+	for scenario in scenarios:
+		build(scenario.get('make', []))
+		results = run(scenario)
+		failed = check(results, scenario['gates'])
+		nfailed += bool(failed)
+
+		prev = last_results(args.history, scenario['name'])
+		delta = ""
+		if prev is not None:
+			delta = " (PDR {:+.2f}, DC {:+.3f} since {})".format(
+				results['pdr'] - prev['results']['pdr'],
+				results['dc_avg'] - prev['results']['dc_avg'], prev['commit'])
+		print("{:<14} {:>8.2f} {:>8.3f} {:>8.3f} {:>10.3f}  {}{}".format(
+			scenario['name'], results['pdr'], results['dc_avg'], results['dc_max'],
+			results['sync_err_max_ms'], "FAIL: " + ", ".join(failed) if failed else "ok",
+			delta))
+
+		if not args.no_history:
+			with open(args.history, 'a') as f:
+				f.write(json.dumps({'time': time.strftime('%Y-%m-%dT%H:%M:%S'),
+					'commit': commit, 'scenario': scenario['name'],
+					'make': scenario.get('make', []), 'args': scenario['args'],
+					'results': results, 'failed': failed}) + "\n")
+
+	# Leave the default build in place
+	build([])
+	sys.exit(1 if nfailed else 0)
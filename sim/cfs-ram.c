@@ -0,0 +1,225 @@
+/*
+ * Coffee file system of the simulated nodes: files are extents of a flash
+ * image kept by the simulator (sim_flash()). Like Coffee, the file table
+ * is in flash too, so that the files survive a reboot of the node, a file
+ * has a fixed size (default or reserved) and its end is the furthest byte
+ * written. The open files live in the node state.
+ */
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "sim.h"
+/*---------------------------------------------------------------------------*/
+#define CFS_FLASH_SIZE   (64 * 1024UL)
+#define CFS_MAX_FILES    32
+#define CFS_MAX_FDS      4
+#define CFS_NAME_LEN     16
+#define CFS_DEFAULT_SIZE 1024
+/*---------------------------------------------------------------------------*/
+/* Head of the flash image, erased flash is an empty table */
+struct cfs_table {
+  struct {
+    char name[CFS_NAME_LEN]; /* empty for a free extent */
+    uint32_t start, size, end;
+  } files[CFS_MAX_FILES];
+  uint8_t nfiles;
+  uint32_t flash_used;
+};
+static struct {
+  int file; /* -1 when closed */
+  cfs_offset_t offset;
+  int flags;
+} fds[CFS_MAX_FDS];
+static uint8_t fds_ready;
+/*---------------------------------------------------------------------------*/
+static struct cfs_table *
+table(void)
+{
+  return (struct cfs_table *)sim_flash(sizeof(struct cfs_table) + CFS_FLASH_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+file_data(int f)
+{
+  return (uint8_t *)table() + sizeof(struct cfs_table) + table()->files[f].start;
+}
+/*---------------------------------------------------------------------------*/
+static int
+find_file(const char *name)
+{
+  int i;
+  struct cfs_table *t = table();
+
+  for(i = 0; i < t->nfiles; i++) {
+    if(t->files[i].name[0] != '\0' && strncmp(t->files[i].name, name, CFS_NAME_LEN) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+/* First fit among the extents of removed files, else at the end */
+static int
+create_file(const char *name, uint32_t size)
+{
+  int i;
+  struct cfs_table *t = table();
+
+  if(strlen(name) >= CFS_NAME_LEN) {
+    return -1;
+  }
+  for(i = 0; i < t->nfiles; i++) {
+    if(t->files[i].name[0] == '\0' && t->files[i].size >= size) {
+      break;
+    }
+  }
+  if(i == t->nfiles) {
+    if(t->nfiles == CFS_MAX_FILES || t->flash_used + size > CFS_FLASH_SIZE) {
+      return -1;
+    }
+    t->files[i].start = t->flash_used;
+    t->files[i].size = size;
+    t->flash_used += size;
+    t->nfiles++;
+  }
+  strcpy(t->files[i].name, name);
+  t->files[i].end = 0;
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static int
+valid_fd(int fd)
+{
+  return fd >= 0 && fd < CFS_MAX_FDS && fds_ready && fds[fd].file >= 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_open(const char *name, int flags)
+{
+  int fd, f;
+  struct cfs_table *t = table();
+
+  if(!fds_ready) {
+    for(fd = 0; fd < CFS_MAX_FDS; fd++) {
+      fds[fd].file = -1;
+    }
+    fds_ready = 1;
+  }
+  for(fd = 0; fd < CFS_MAX_FDS && fds[fd].file >= 0; fd++);
+  if(fd == CFS_MAX_FDS) {
+    return -1;
+  }
+
+  f = find_file(name);
+  if(f < 0) {
+    if(!(flags & CFS_WRITE) || (f = create_file(name, CFS_DEFAULT_SIZE)) < 0) {
+      return -1;
+    }
+  }
+  fds[fd].file = f;
+  fds[fd].flags = flags;
+  fds[fd].offset = (flags & CFS_APPEND) ? (cfs_offset_t)t->files[f].end : 0;
+  return fd;
+}
+/*---------------------------------------------------------------------------*/
+void
+cfs_close(int fd)
+{
+  if(valid_fd(fd)) {
+    fds[fd].file = -1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_read(int fd, void *buf, unsigned int len)
+{
+  uint32_t end;
+  struct cfs_table *t = table();
+
+  if(!valid_fd(fd) || !(fds[fd].flags & CFS_READ)) {
+    return -1;
+  }
+  end = t->files[fds[fd].file].end;
+  if(fds[fd].offset + len > end) {
+    len = fds[fd].offset < end ? end - fds[fd].offset : 0;
+  }
+  memcpy(buf, file_data(fds[fd].file) + fds[fd].offset, len);
+  fds[fd].offset += len;
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_write(int fd, const void *buf, unsigned int len)
+{
+  int f;
+  struct cfs_table *t = table();
+
+  if(!valid_fd(fd) || !(fds[fd].flags & CFS_WRITE)) {
+    return -1;
+  }
+  f = fds[fd].file;
+  if(fds[fd].offset + len > t->files[f].size) {
+    len = fds[fd].offset < t->files[f].size ? t->files[f].size - fds[fd].offset : 0;
+  }
+  memcpy(file_data(f) + fds[fd].offset, buf, len);
+  fds[fd].offset += len;
+  if(fds[fd].offset > t->files[f].end) {
+    t->files[f].end = fds[fd].offset;
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+cfs_offset_t
+cfs_seek(int fd, cfs_offset_t offset, int whence)
+{
+  cfs_offset_t base = 0;
+  struct cfs_table *t = table();
+
+  if(!valid_fd(fd)) {
+    return -1;
+  }
+  if(whence == CFS_SEEK_CUR) {
+    base = fds[fd].offset;
+  } else if(whence == CFS_SEEK_END) {
+    base = t->files[fds[fd].file].end;
+  }
+  if(base + offset < 0 || base + offset > (cfs_offset_t)t->files[fds[fd].file].size) {
+    return -1;
+  }
+  fds[fd].offset = base + offset;
+  return fds[fd].offset;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_remove(const char *name)
+{
+  struct cfs_table *t = table();
+  int f = find_file(name);
+
+  if(f < 0) {
+    return -1;
+  }
+  t->files[f].name[0] = '\0';
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_coffee_reserve(const char *name, cfs_offset_t size)
+{
+  if(size <= 0 || find_file(name) >= 0) {
+    return -1;
+  }
+  return create_file(name, size) < 0 ? -1 : 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+cfs_coffee_format(void)
+{
+  struct cfs_table *t = table();
+
+  t->nfiles = 0;
+  t->flash_used = 0;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
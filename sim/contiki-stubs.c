@@ -0,0 +1,599 @@
+/*
+ * Node side of the host simulator: a tiny Contiki runtime (processes,
+ * timers, packetbuf, Rime broadcast/unicast) on top of sim.h.
+ *
+ * This file is linked with the firmware sources into the per-node state
+ * image (see node-state.ld), so every static variable below exists once
+ * per simulated node.
+ */
+#include <stdio.h>
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/rime/rime.h"
+#include "net/netstack.h"
+#include "leds.h"
+#include "sys/node-id.h"
+#include "dev/serial-line.h"
+#include "sim.h"
+/*---------------------------------------------------------------------------*/
+#define EVENT_QUEUE_SIZE 32
+#define MAX_CONNS 8
+/*---------------------------------------------------------------------------*/
+unsigned short node_id;
+linkaddr_t linkaddr_node_addr;
+const linkaddr_t linkaddr_null = {{0, 0}};
+process_event_t serial_line_event_message;
+struct process *process_current;
+/*---------------------------------------------------------------------------*/
+static struct process *process_list;
+static process_event_t lastevent;
+static struct {
+  struct process *p;
+  process_event_t ev;
+  process_data_t data;
+} events[EVENT_QUEUE_SIZE];
+static uint8_t fevent, nevents;
+/*---------------------------------------------------------------------------*/
+static uint32_t rand_state;
+static unsigned char leds;
+/*---------------------------------------------------------------------------*/
+/* Contiki 3 packetbuf layout: header grows backwards from the data area */
+static uint32_t packetbuf_aligned[(PACKETBUF_SIZE + PACKETBUF_HDR_SIZE + 3) / 4];
+static uint8_t *packetbuf = (uint8_t *)packetbuf_aligned;
+static uint16_t buflen, bufptr;
+static uint8_t hdrlen;
+static packetbuf_attr_t attrs[PACKETBUF_NUM_ATTRS];
+/*---------------------------------------------------------------------------*/
+static struct {
+  uint16_t channel;
+  struct broadcast_conn *bc;
+  struct unicast_conn *uc;
+} conns[MAX_CONNS];
+/*---------------------------------------------------------------------------*/
+/* Clock */
+clock_time_t
+clock_time(void)
+{
+  return (clock_time_t)(sim_now_us() * CLOCK_SECOND / 1000000);
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+clock_seconds(void)
+{
+  return sim_now_us() / 1000000;
+}
+/*---------------------------------------------------------------------------*/
+static uint64_t
+ticks_to_us(clock_time_t t)
+{
+  return (uint64_t)t * 1000000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+/* Processes */
+static void
+call_process(struct process *p, process_event_t ev, process_data_t data)
+{
+  struct process *caller = process_current;
+  char ret;
+
+  if(!p->state) {
+    return;
+  }
+  process_current = p;
+  ret = p->thread(&p->pt, ev, data);
+  if(ret == PT_EXITED || ret == PT_ENDED || ev == PROCESS_EVENT_EXIT) {
+    process_exit(p);
+  }
+  process_current = caller;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_start(struct process *p, process_data_t data)
+{
+  struct process *q;
+
+  for(q = process_list; q != NULL; q = q->next) {
+    if(q == p) {
+      return; /* already running */
+    }
+  }
+  p->next = process_list;
+  process_list = p;
+  p->state = 1;
+  PT_INIT(&p->pt);
+  call_process(p, PROCESS_EVENT_INIT, data);
+}
+/*---------------------------------------------------------------------------*/
+void
+process_exit(struct process *p)
+{
+  struct process **q;
+
+  p->state = 0;
+  for(q = &process_list; *q != NULL; q = &(*q)->next) {
+    if(*q == p) {
+      *q = p->next;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+process_is_running(struct process *p)
+{
+  return p->state != 0;
+}
+/*---------------------------------------------------------------------------*/
+process_event_t
+process_alloc_event(void)
+{
+  return lastevent++;
+}
+/*---------------------------------------------------------------------------*/
+int
+process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+  uint8_t snum;
+
+  if(nevents == EVENT_QUEUE_SIZE) {
+    printf("sim: event queue full\n");
+    return 1;
+  }
+  snum = (fevent + nevents) % EVENT_QUEUE_SIZE;
+  events[snum].p = p;
+  events[snum].ev = ev;
+  events[snum].data = data;
+  nevents++;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+process_post_synch(struct process *p, process_event_t ev, process_data_t data)
+{
+  call_process(p, ev, data);
+}
+/*---------------------------------------------------------------------------*/
+/* Deliver all posted events, including those posted meanwhile */
+static void
+process_run_all(void)
+{
+  struct process *p, *next;
+  process_event_t ev;
+  process_data_t data;
+
+  while(nevents > 0) {
+    p = events[fevent].p;
+    ev = events[fevent].ev;
+    data = events[fevent].data;
+    fevent = (fevent + 1) % EVENT_QUEUE_SIZE;
+    nevents--;
+
+    if(p == PROCESS_BROADCAST) {
+      for(p = process_list; p != NULL; p = next) {
+        next = p->next;
+        call_process(p, ev, data);
+      }
+    } else {
+      call_process(p, ev, data);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Timers */
+static void
+timer_schedule(struct etimer *et, uint8_t kind)
+{
+  et->gen++;
+  et->pending = true;
+  sim_timer_schedule(et, et->gen, kind, et->expire_us);
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_set(struct etimer *et, clock_time_t interval)
+{
+  et->p = PROCESS_CURRENT();
+  et->timer.start = clock_time();
+  et->timer.interval = interval;
+  et->expire_us = sim_now_us() + ticks_to_us(interval);
+  timer_schedule(et, SIM_TIMER_ETIMER);
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_reset(struct etimer *et)
+{
+  et->timer.start += et->timer.interval;
+  et->expire_us += ticks_to_us(et->timer.interval);
+  timer_schedule(et, SIM_TIMER_ETIMER);
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_restart(struct etimer *et)
+{
+  etimer_set(et, et->timer.interval);
+}
+/*---------------------------------------------------------------------------*/
+void
+etimer_stop(struct etimer *et)
+{
+  et->gen++;
+  et->pending = false;
+}
+/*---------------------------------------------------------------------------*/
+int
+etimer_expired(struct etimer *et)
+{
+  return !et->pending;
+}
+/*---------------------------------------------------------------------------*/
+clock_time_t
+etimer_expiration_time(struct etimer *et)
+{
+  return et->timer.start + et->timer.interval;
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_set(struct ctimer *c, clock_time_t t, void (* f)(void *), void *ptr)
+{
+  c->p = PROCESS_CURRENT();
+  c->f = f;
+  c->ptr = ptr;
+  c->etimer.timer.start = clock_time();
+  c->etimer.timer.interval = t;
+  c->etimer.expire_us = sim_now_us() + ticks_to_us(t);
+  timer_schedule(&c->etimer, SIM_TIMER_CTIMER);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_reset(struct ctimer *c)
+{
+  c->etimer.timer.start += c->etimer.timer.interval;
+  c->etimer.expire_us += ticks_to_us(c->etimer.timer.interval);
+  timer_schedule(&c->etimer, SIM_TIMER_CTIMER);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_restart(struct ctimer *c)
+{
+  ctimer_set(c, c->etimer.timer.interval, c->f, c->ptr);
+}
+/*---------------------------------------------------------------------------*/
+void
+ctimer_stop(struct ctimer *c)
+{
+  etimer_stop(&c->etimer);
+}
+/*---------------------------------------------------------------------------*/
+int
+ctimer_expired(struct ctimer *c)
+{
+  return etimer_expired(&c->etimer);
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_node_timer(void *timer, uint32_t gen, uint8_t kind)
+{
+  struct etimer *et = timer;
+  struct ctimer *c = timer;
+  struct process *caller = process_current;
+
+  if(!et->pending || et->gen != gen) {
+    return; /* stopped or rescheduled meanwhile */
+  }
+  et->pending = false;
+
+  if(kind == SIM_TIMER_CTIMER) {
+    process_current = c->p;
+    c->f(c->ptr);
+    process_current = caller;
+  } else {
+    process_post(et->p, PROCESS_EVENT_TIMER, et);
+  }
+  process_run_all();
+}
+/*---------------------------------------------------------------------------*/
+/* Random */
+void
+random_init(unsigned short seed)
+{
+  rand_state = seed;
+}
+/*---------------------------------------------------------------------------*/
+unsigned short
+random_rand(void)
+{
+  rand_state = rand_state * 1103515245 + 12345;
+  return rand_state >> 16;
+}
+/*---------------------------------------------------------------------------*/
+/* LEDs */
+void leds_on(unsigned char l) { leds |= l; }
+void leds_off(unsigned char l) { leds &= ~l; }
+void leds_toggle(unsigned char l) { leds ^= l; }
+unsigned char leds_get(void) { return leds; }
+/*---------------------------------------------------------------------------*/
+/* Link addresses */
+void
+linkaddr_copy(linkaddr_t *dest, const linkaddr_t *from)
+{
+  memcpy(dest, from, LINKADDR_SIZE);
+}
+/*---------------------------------------------------------------------------*/
+int
+linkaddr_cmp(const linkaddr_t *addr1, const linkaddr_t *addr2)
+{
+  return memcmp(addr1, addr2, LINKADDR_SIZE) == 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+linkaddr_set_node_addr(linkaddr_t *addr)
+{
+  linkaddr_copy(&linkaddr_node_addr, addr);
+}
+/*---------------------------------------------------------------------------*/
+/* Packet buffer */
+void
+packetbuf_clear(void)
+{
+  buflen = bufptr = 0;
+  hdrlen = 0;
+  memset(attrs, 0, sizeof(attrs));
+}
+/*---------------------------------------------------------------------------*/
+void *packetbuf_dataptr(void) { return packetbuf + PACKETBUF_HDR_SIZE + bufptr; }
+void *packetbuf_hdrptr(void) { return packetbuf + PACKETBUF_HDR_SIZE - hdrlen; }
+uint16_t packetbuf_datalen(void) { return buflen; }
+uint16_t packetbuf_hdrlen(void) { return hdrlen; }
+uint16_t packetbuf_totlen(void) { return hdrlen + buflen; }
+void packetbuf_set_datalen(uint16_t len) { buflen = len; }
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_copyfrom(const void *from, uint16_t len)
+{
+  uint16_t l;
+
+  packetbuf_clear();
+  l = len > PACKETBUF_SIZE ? PACKETBUF_SIZE : len;
+  memcpy(packetbuf_dataptr(), from, l);
+  buflen = l;
+  return l;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_hdralloc(int size)
+{
+  if(size + hdrlen > PACKETBUF_HDR_SIZE) {
+    return 0;
+  }
+  hdrlen += size;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_hdrreduce(int size)
+{
+  if(buflen < size) {
+    return 0;
+  }
+  bufptr += size;
+  buflen -= size;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val)
+{
+  attrs[type] = val;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+packetbuf_attr_t
+packetbuf_attr(uint8_t type)
+{
+  return attrs[type];
+}
+/*---------------------------------------------------------------------------*/
+/* Rime */
+static int
+conn_slot(uint16_t channel)
+{
+  int i, free_slot = -1;
+
+  for(i = 0; i < MAX_CONNS; i++) {
+    if((conns[i].bc != NULL || conns[i].uc != NULL) && conns[i].channel == channel) {
+      return i;
+    }
+    if(free_slot < 0 && conns[i].bc == NULL && conns[i].uc == NULL) {
+      free_slot = i;
+    }
+  }
+  if(free_slot >= 0) {
+    conns[free_slot].channel = channel;
+  }
+  return free_slot;
+}
+/*---------------------------------------------------------------------------*/
+static int
+send_frame(uint16_t channel, const linkaddr_t *dest)
+{
+  /* hdr and data are contiguous unless the header was reduced */
+  uint8_t frame[PACKETBUF_HDR_SIZE + PACKETBUF_SIZE];
+
+  memcpy(frame, packetbuf_hdrptr(), hdrlen);
+  memcpy(frame + hdrlen, packetbuf_dataptr(), buflen);
+  sim_radio_send(channel, dest, frame, hdrlen + buflen);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+broadcast_open(struct broadcast_conn *c, uint16_t channel,
+               const struct broadcast_callbacks *u)
+{
+  int i = conn_slot(channel);
+
+  c->channel = channel;
+  c->u = u;
+  if(i >= 0) {
+    conns[i].bc = c;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+broadcast_close(struct broadcast_conn *c)
+{
+  int i;
+
+  for(i = 0; i < MAX_CONNS; i++) {
+    if(conns[i].bc == c) {
+      conns[i].bc = NULL;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+broadcast_send(struct broadcast_conn *c)
+{
+  return send_frame(c->channel, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+unicast_open(struct unicast_conn *c, uint16_t channel,
+             const struct unicast_callbacks *u)
+{
+  int i = conn_slot(channel);
+
+  c->c.channel = channel;
+  c->u = u;
+  if(i >= 0) {
+    conns[i].uc = c;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+unicast_close(struct unicast_conn *c)
+{
+  int i;
+
+  for(i = 0; i < MAX_CONNS; i++) {
+    if(conns[i].uc == c) {
+      conns[i].uc = NULL;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+unicast_send(struct unicast_conn *c, const linkaddr_t *receiver)
+{
+  return send_frame(c->c.channel, receiver);
+}
+/*---------------------------------------------------------------------------*/
+void
+sim_node_input(uint16_t channel, const linkaddr_t *sender,
+               const uint8_t *frame, uint16_t len, int16_t rssi)
+{
+  int i;
+  linkaddr_t from;
+
+  linkaddr_copy(&from, sender);
+  for(i = 0; i < MAX_CONNS; i++) {
+    if(conns[i].channel != channel) {
+      continue;
+    }
+    packetbuf_copyfrom(frame, len);
+    packetbuf_set_attr(PACKETBUF_ATTR_RSSI, (packetbuf_attr_t)rssi);
+    if(conns[i].uc != NULL && conns[i].uc->u->recv != NULL) {
+      conns[i].uc->u->recv(conns[i].uc, &from);
+    } else if(conns[i].bc != NULL && conns[i].bc->u->recv != NULL) {
+      conns[i].bc->u->recv(conns[i].bc, &from);
+    }
+    break;
+  }
+  process_run_all();
+}
+/*---------------------------------------------------------------------------*/
+/* End of a transmission: the frame was acked, or dropped by the MAC */
+void
+sim_node_sent(uint16_t channel, int status, int num_tx)
+{
+  int i;
+
+  for(i = 0; i < MAX_CONNS; i++) {
+    if(conns[i].channel != channel) {
+      continue;
+    }
+    if(conns[i].uc != NULL && conns[i].uc->u->sent != NULL) {
+      conns[i].uc->u->sent(conns[i].uc, status, num_tx);
+    } else if(conns[i].bc != NULL && conns[i].bc->u->sent != NULL) {
+      conns[i].bc->u->sent(conns[i].bc, status, num_tx);
+    }
+    break;
+  }
+  process_run_all();
+}
+/*---------------------------------------------------------------------------*/
+/* MAC: nullrdc, on/off switch the radio */
+static int mac_on(void) { sim_radio_set(1); return 1; }
+static int mac_off(int keep_radio_on) { sim_radio_set(keep_radio_on); return 1; }
+const struct mac_driver sim_mac_driver = { "nullrdc", mac_on, mac_off };
+/*---------------------------------------------------------------------------*/
+/* Radio: channel selection */
+static radio_result_t
+radio_get_value(radio_param_t param, radio_value_t *value)
+{
+  if(param != RADIO_PARAM_CHANNEL) {
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
+  *value = sim_radio_get_channel();
+  return RADIO_RESULT_OK;
+}
+static radio_result_t
+radio_set_value(radio_param_t param, radio_value_t value)
+{
+  if(param != RADIO_PARAM_CHANNEL) {
+    return RADIO_RESULT_NOT_SUPPORTED;
+  }
+  if(value < 11 || value > 26) {
+    return RADIO_RESULT_INVALID_VALUE;
+  }
+  sim_radio_channel(value);
+  return RADIO_RESULT_OK;
+}
+const struct radio_driver sim_radio_driver = { radio_get_value, radio_set_value };
+/*---------------------------------------------------------------------------*/
+/* Energest */
+void energest_flush(void) {}
+unsigned long energest_type_time(int type) { return sim_energest(type); }
+/*---------------------------------------------------------------------------*/
+/* Serial line input */
+void
+sim_node_serial(const char *line)
+{
+  static char buf[128];
+
+  strncpy(buf, line, sizeof(buf) - 1);
+  process_post(PROCESS_BROADCAST, serial_line_event_message, buf);
+  process_run_all();
+}
+/*---------------------------------------------------------------------------*/
+/* Boot: what contiki-main does on a Cooja Sky mote */
+void
+sim_node_boot(uint16_t id)
+{
+  struct process * const *p;
+
+  node_id = id;
+  linkaddr_node_addr.u8[0] = id & 0xff;
+  linkaddr_node_addr.u8[1] = id >> 8;
+  random_init(id ^ sim_seed());
+  lastevent = PROCESS_EVENT_MAX;
+  serial_line_event_message = process_alloc_event();
+  printf("Rime started with address %u.%u\n",
+         linkaddr_node_addr.u8[0], linkaddr_node_addr.u8[1]);
+  printf("Node id is set to %u.\n", node_id);
+  sim_radio_set(1);
+
+  for(p = autostart_processes; *p != NULL; p++) {
+    process_start(*p, NULL);
+  }
+  process_run_all();
+}
+/*---------------------------------------------------------------------------*/
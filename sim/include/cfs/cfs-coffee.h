@@ -0,0 +1,9 @@
+#ifndef CFS_COFFEE_H_
+#define CFS_COFFEE_H_
+/*---------------------------------------------------------------------------*/
+#include "cfs/cfs.h"
+/*---------------------------------------------------------------------------*/
+int cfs_coffee_reserve(const char *name, cfs_offset_t size);
+int cfs_coffee_format(void);
+/*---------------------------------------------------------------------------*/
+#endif /* CFS_COFFEE_H_ */
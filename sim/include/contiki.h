@@ -0,0 +1,171 @@
+/*
+ * Minimal Contiki API for the host simulator (see sim/README.md).
+ * Only what app.c, sched_collect.c and the tools use is provided.
+ * Every variable declared here lives in the per-node state of the
+ * simulator, so each simulated node has its own copy.
+ */
+#ifndef CONTIKI_H_
+#define CONTIKI_H_
+/*---------------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+/*---------------------------------------------------------------------------*/
+#ifdef PROJECT_CONF_H
+#include PROJECT_CONF_H
+#endif
+/*---------------------------------------------------------------------------*/
+/* Clock: Tmote Sky has a 16 bit clock_time_t, the Firefly a 32 bit one */
+#ifdef CLOCK_CONF_SECOND
+#define CLOCK_SECOND CLOCK_CONF_SECOND
+#else
+#define CLOCK_SECOND 128UL
+#endif
+#ifdef CONTIKI_TARGET_SKY
+typedef unsigned short clock_time_t;
+#else
+typedef uint32_t clock_time_t;
+#endif
+clock_time_t clock_time(void);
+unsigned long clock_seconds(void);
+/*---------------------------------------------------------------------------*/
+/* Protothreads (switch based local continuations) */
+typedef unsigned short lc_t;
+#define LC_INIT(s) s = 0;
+#define LC_RESUME(s) switch(s) { case 0:
+#define LC_SET(s) s = __LINE__; case __LINE__:
+#define LC_END(s) }
+
+struct pt { lc_t lc; };
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2
+#define PT_ENDED   3
+
+#define PT_INIT(pt) LC_INIT((pt)->lc)
+#define PT_BEGIN(pt) { char PT_YIELD_FLAG = 1; if (PT_YIELD_FLAG) {;} LC_RESUME((pt)->lc)
+#define PT_END(pt) LC_END((pt)->lc); PT_YIELD_FLAG = 0; \
+                   PT_INIT(pt); return PT_ENDED; }
+#define PT_WAIT_UNTIL(pt, condition)          \
+  do {                                        \
+    LC_SET((pt)->lc);                         \
+    if(!(condition)) {                        \
+      return PT_WAITING;                      \
+    }                                         \
+  } while(0)
+#define PT_YIELD(pt)                          \
+  do {                                        \
+    PT_YIELD_FLAG = 0;                        \
+    LC_SET((pt)->lc);                         \
+    if(PT_YIELD_FLAG == 0) {                  \
+      return PT_YIELDED;                      \
+    }                                         \
+  } while(0)
+#define PT_YIELD_UNTIL(pt, cond)              \
+  do {                                        \
+    PT_YIELD_FLAG = 0;                        \
+    LC_SET((pt)->lc);                         \
+    if((PT_YIELD_FLAG == 0) || !(cond)) {     \
+      return PT_YIELDED;                      \
+    }                                         \
+  } while(0)
+#define PT_EXIT(pt) do { PT_INIT(pt); return PT_EXITED; } while(0)
+/*---------------------------------------------------------------------------*/
+/* Processes */
+typedef unsigned char process_event_t;
+typedef void *process_data_t;
+
+#define PROCESS_EVENT_NONE  0x80
+#define PROCESS_EVENT_INIT  0x81
+#define PROCESS_EVENT_POLL  0x82
+#define PROCESS_EVENT_EXIT  0x83
+#define PROCESS_EVENT_TIMER 0x88
+#define PROCESS_EVENT_MAX   0x8a
+
+#define PROCESS_BROADCAST NULL
+#define PROCESS_NONE NULL
+
+struct process {
+  struct process *next;
+  const char *name;
+  char (* thread)(struct pt *, process_event_t, process_data_t);
+  struct pt pt;
+  unsigned char state;
+};
+
+#define PROCESS_THREAD(name, ev, data)                          \
+  static char process_thread_##name(struct pt *process_pt,      \
+                                    process_event_t ev,         \
+                                    process_data_t data)
+#define PROCESS_NAME(name) extern struct process name
+#define PROCESS(name, strname)                                  \
+  PROCESS_THREAD(name, ev, data);                               \
+  struct process name = { NULL, strname, process_thread_##name }
+#define AUTOSTART_PROCESSES(...)                                \
+  struct process * const autostart_processes[] = {__VA_ARGS__, NULL}
+
+#define PROCESS_BEGIN() PT_BEGIN(process_pt)
+#define PROCESS_END() PT_END(process_pt)
+#define PROCESS_WAIT_EVENT() PT_YIELD(process_pt)
+#define PROCESS_WAIT_EVENT_UNTIL(c) PT_YIELD_UNTIL(process_pt, c)
+#define PROCESS_YIELD() PT_YIELD(process_pt)
+#define PROCESS_YIELD_UNTIL(c) PT_YIELD_UNTIL(process_pt, c)
+#define PROCESS_WAIT_UNTIL(c) PT_WAIT_UNTIL(process_pt, c)
+#define PROCESS_EXIT() PT_EXIT(process_pt)
+#define PROCESS_CURRENT() process_current
+
+extern struct process *process_current;
+extern struct process * const autostart_processes[];
+
+void process_start(struct process *p, process_data_t data);
+void process_exit(struct process *p);
+int process_post(struct process *p, process_event_t ev, process_data_t data);
+void process_post_synch(struct process *p, process_event_t ev, process_data_t data);
+process_event_t process_alloc_event(void);
+int process_is_running(struct process *p);
+/*---------------------------------------------------------------------------*/
+/* Timers: the simulator keeps the pending expirations, a timer only
+ * stores a generation number to tell stale expirations apart */
+struct timer {
+  clock_time_t start;
+  clock_time_t interval;
+};
+struct etimer {
+  struct timer timer;
+  struct process *p;
+  uint64_t expire_us; // absolute expiration in simulated time
+  uint32_t gen;
+  bool pending;
+};
+struct ctimer {
+  struct etimer etimer;
+  struct process *p;
+  void (* f)(void *);
+  void *ptr;
+};
+
+void etimer_set(struct etimer *et, clock_time_t interval);
+void etimer_reset(struct etimer *et);
+void etimer_restart(struct etimer *et);
+void etimer_stop(struct etimer *et);
+int etimer_expired(struct etimer *et);
+clock_time_t etimer_expiration_time(struct etimer *et);
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (* f)(void *), void *ptr);
+void ctimer_reset(struct ctimer *c);
+void ctimer_restart(struct ctimer *c);
+void ctimer_stop(struct ctimer *c);
+int ctimer_expired(struct ctimer *c);
+/*---------------------------------------------------------------------------*/
+/* Energest, times are in RTIMER_SECOND ticks */
+#define RTIMER_SECOND 32768UL
+#define ENERGEST_TYPE_CPU 0
+#define ENERGEST_TYPE_LPM 1
+#define ENERGEST_TYPE_TRANSMIT 2
+#define ENERGEST_TYPE_LISTEN 3
+void energest_flush(void);
+unsigned long energest_type_time(int type);
+/*---------------------------------------------------------------------------*/
+#endif /* CONTIKI_H_ */
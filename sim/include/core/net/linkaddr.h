@@ -0,0 +1,19 @@
+#ifndef LINKADDR_H_
+#define LINKADDR_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+/*---------------------------------------------------------------------------*/
+#define LINKADDR_SIZE 2
+typedef union {
+  unsigned char u8[LINKADDR_SIZE];
+  uint16_t u16;
+} linkaddr_t;
+
+extern linkaddr_t linkaddr_node_addr;
+extern const linkaddr_t linkaddr_null;
+
+void linkaddr_copy(linkaddr_t *dest, const linkaddr_t *from);
+int linkaddr_cmp(const linkaddr_t *addr1, const linkaddr_t *addr2);
+void linkaddr_set_node_addr(linkaddr_t *addr);
+/*---------------------------------------------------------------------------*/
+#endif /* LINKADDR_H_ */
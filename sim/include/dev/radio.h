@@ -0,0 +1,21 @@
+#ifndef RADIO_H_
+#define RADIO_H_
+/*---------------------------------------------------------------------------*/
+/* Radio driver: only the channel can be configured */
+typedef int radio_value_t;
+typedef unsigned radio_param_t;
+enum {
+  RADIO_PARAM_CHANNEL,
+};
+typedef enum {
+  RADIO_RESULT_OK,
+  RADIO_RESULT_NOT_SUPPORTED,
+  RADIO_RESULT_INVALID_VALUE,
+  RADIO_RESULT_ERROR,
+} radio_result_t;
+struct radio_driver {
+  radio_result_t (* get_value)(radio_param_t param, radio_value_t *value);
+  radio_result_t (* set_value)(radio_param_t param, radio_value_t value);
+};
+/*---------------------------------------------------------------------------*/
+#endif /* RADIO_H_ */
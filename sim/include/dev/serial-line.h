@@ -0,0 +1,9 @@
+#ifndef SERIAL_LINE_H_
+#define SERIAL_LINE_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+/*---------------------------------------------------------------------------*/
+/* Posted to all processes with the line as data (see sim --input) */
+extern process_event_t serial_line_event_message;
+/*---------------------------------------------------------------------------*/
+#endif /* SERIAL_LINE_H_ */
@@ -0,0 +1 @@
+#include "core/net/linkaddr.h"
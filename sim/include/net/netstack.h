@@ -0,0 +1,27 @@
+#ifndef NETSTACK_H_
+#define NETSTACK_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "dev/radio.h"
+/*---------------------------------------------------------------------------*/
+/* Radio duty cycling (the project uses nullrdc: on/off switch the radio) */
+struct mac_driver {
+  char *name;
+  int (* on)(void);
+  int (* off)(int keep_radio_on);
+};
+extern const struct mac_driver sim_mac_driver;
+/* Outcome of a transmission, reported to the Rime sent callbacks */
+enum {
+  MAC_TX_OK,
+  MAC_TX_COLLISION,
+  MAC_TX_NOACK,
+  MAC_TX_DEFERRED,
+  MAC_TX_ERR,
+  MAC_TX_ERR_FATAL,
+};
+#define NETSTACK_MAC sim_mac_driver
+extern const struct radio_driver sim_radio_driver;
+#define NETSTACK_RADIO sim_radio_driver
+/*---------------------------------------------------------------------------*/
+#endif /* NETSTACK_H_ */
@@ -0,0 +1,64 @@
+#ifndef RIME_H_
+#define RIME_H_
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+/*---------------------------------------------------------------------------*/
+/* Packet buffer */
+#define PACKETBUF_SIZE 128
+#define PACKETBUF_HDR_SIZE 48
+
+enum {
+  PACKETBUF_ATTR_NONE,
+  PACKETBUF_ATTR_RSSI,
+  PACKETBUF_ATTR_LINK_QUALITY,
+  PACKETBUF_ATTR_CHANNEL,
+  PACKETBUF_NUM_ATTRS
+};
+typedef uint16_t packetbuf_attr_t;
+
+void packetbuf_clear(void);
+void *packetbuf_dataptr(void);
+void *packetbuf_hdrptr(void);
+uint16_t packetbuf_datalen(void);
+uint16_t packetbuf_hdrlen(void);
+uint16_t packetbuf_totlen(void);
+void packetbuf_set_datalen(uint16_t len);
+int packetbuf_copyfrom(const void *from, uint16_t len);
+int packetbuf_hdralloc(int size);
+int packetbuf_hdrreduce(int size);
+int packetbuf_set_attr(uint8_t type, const packetbuf_attr_t val);
+packetbuf_attr_t packetbuf_attr(uint8_t type);
+/*---------------------------------------------------------------------------*/
+/* Rime broadcast and unicast */
+struct broadcast_conn;
+struct broadcast_callbacks {
+  void (* recv)(struct broadcast_conn *ptr, const linkaddr_t *sender);
+  void (* sent)(struct broadcast_conn *ptr, int status, int num_tx);
+};
+struct broadcast_conn {
+  uint16_t channel;
+  const struct broadcast_callbacks *u;
+};
+
+struct unicast_conn;
+struct unicast_callbacks {
+  void (* recv)(struct unicast_conn *c, const linkaddr_t *from);
+  void (* sent)(struct unicast_conn *ptr, int status, int num_tx);
+};
+struct unicast_conn {
+  struct broadcast_conn c;
+  const struct unicast_callbacks *u;
+};
+
+void broadcast_open(struct broadcast_conn *c, uint16_t channel,
+                    const struct broadcast_callbacks *u);
+void broadcast_close(struct broadcast_conn *c);
+int broadcast_send(struct broadcast_conn *c);
+
+void unicast_open(struct unicast_conn *c, uint16_t channel,
+                  const struct unicast_callbacks *u);
+void unicast_close(struct unicast_conn *c);
+int unicast_send(struct unicast_conn *c, const linkaddr_t *receiver);
+/*---------------------------------------------------------------------------*/
+#endif /* RIME_H_ */
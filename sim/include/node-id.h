@@ -0,0 +1 @@
+#include "sys/node-id.h"
@@ -0,0 +1,6 @@
+#ifndef NODE_ID_H_
+#define NODE_ID_H_
+/*---------------------------------------------------------------------------*/
+extern unsigned short node_id;
+/*---------------------------------------------------------------------------*/
+#endif /* NODE_ID_H_ */
@@ -0,0 +1,174 @@
+#include "link_model.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/* Cooja UDGM signal strength range */
+const double SS_STRONG = -10.0;
+const double SS_WEAK = -95.0;
+
+class Udgm : public LinkModel {
+public:
+  Udgm(std::vector<Position> pos, UdgmParams p) : pos_(std::move(pos)), p_(p) {}
+  const char *name() const override { return "udgm"; }
+  int nodes() const override { return (int)pos_.size(); }
+
+  std::vector<Link> links(int src, int n) const override {
+    std::vector<Link> out;
+    for (int dst = 0; dst < n && dst < (int)pos_.size(); dst++) {
+      if (dst == src)
+        continue;
+      double d = std::hypot(pos_[src].x - pos_[dst].x, pos_[src].y - pos_[dst].y);
+      if (d <= p_.range) {
+        int rssi = (int)std::lround(SS_STRONG + (SS_WEAK - SS_STRONG) * d / p_.range);
+        out.push_back({dst, p_.success_tx * p_.success_rx, rssi, 0.0});
+      } else if (d <= p_.interference) {
+        out.push_back({dst, 0.0, (int)SS_WEAK, 0.0});
+      }
+    }
+    return out;
+  }
+
+private:
+  std::vector<Position> pos_;
+  UdgmParams p_;
+};
+
+class Line : public LinkModel {
+public:
+  explicit Line(double prr) : prr_(prr) {}
+  const char *name() const override { return "line"; }
+
+  std::vector<Link> links(int src, int n) const override {
+    std::vector<Link> out;
+    if (src > 0)
+      out.push_back({src - 1, prr_, -70, 0.0});
+    if (src + 1 < n)
+      out.push_back({src + 1, prr_, -70, 0.0});
+    return out;
+  }
+
+private:
+  double prr_;
+};
+
+class Trace : public LinkModel {
+public:
+  explicit Trace(const std::string &file) {
+    std::ifstream in(file);
+    if (!in)
+      throw std::runtime_error("cannot open trace " + file);
+    std::string line;
+    int lineno = 0;
+    while (std::getline(in, line)) {
+      lineno++;
+      line = line.substr(0, line.find('#'));
+      std::istringstream ss(line);
+      int src, dst;
+      Link l{0, 0.0, 0, 0.0};
+      if (!(ss >> src))
+        continue; // blank or comment
+      if (!(ss >> dst >> l.prr >> l.rssi) || src < 1 || dst < 1)
+        throw std::runtime_error(file + ":" + std::to_string(lineno) + ": malformed link");
+      ss >> l.rssi_std; // optional
+      l.dst = dst - 1;
+      links_[src - 1].push_back(l);
+      nodes_ = std::max(nodes_, std::max(src, dst));
+    }
+  }
+  const char *name() const override { return "trace"; }
+  int nodes() const override { return nodes_; }
+
+  std::vector<Link> links(int src, int n) const override {
+    std::vector<Link> out;
+    auto it = links_.find(src);
+    if (it == links_.end())
+      return out;
+    for (const Link &l : it->second)
+      if (l.dst < n)
+        out.push_back(l);
+    return out;
+  }
+
+private:
+  std::map<int, std::vector<Link>> links_;
+  int nodes_ = 0;
+};
+
+} // namespace
+
+std::unique_ptr<LinkModel> make_udgm(const std::vector<Position> &pos, const UdgmParams &p)
+{
+  return std::unique_ptr<LinkModel>(new Udgm(pos, p));
+}
+
+std::unique_ptr<LinkModel> make_line(double prr)
+{
+  return std::unique_ptr<LinkModel>(new Line(prr));
+}
+
+std::unique_ptr<LinkModel> make_trace(const std::string &file)
+{
+  return std::unique_ptr<LinkModel>(new Trace(file));
+}
+
+std::vector<Position> load_csc(const std::string &file, UdgmParams *p)
+{
+  std::ifstream in(file);
+  if (!in)
+    throw std::runtime_error("cannot open " + file);
+  std::stringstream buf;
+  buf << in.rdbuf();
+  const std::string xml = buf.str();
+
+  auto param = [&](const char *tag, double *v) {
+    std::smatch m;
+    std::regex re(std::string("<") + tag + ">([^<]+)</" + tag + ">");
+    if (std::regex_search(xml, m, re))
+      *v = std::stod(m[1]);
+  };
+  param("transmitting_range", &p->range);
+  param("interference_range", &p->interference);
+  param("success_ratio_tx", &p->success_tx);
+  param("success_ratio_rx", &p->success_rx);
+
+  /* <mote> ... Position <x>..</x> <y>..</y> ... MspMoteID <id>..</id> ... </mote> */
+  std::map<int, Position> by_id;
+  std::regex mote_re("<mote>([\\s\\S]*?)</mote>");
+  std::regex x_re("<x>([^<]+)</x>"), y_re("<y>([^<]+)</y>"), id_re("<id>([^<]+)</id>");
+  for (auto it = std::sregex_iterator(xml.begin(), xml.end(), mote_re); it != std::sregex_iterator(); ++it) {
+    std::string mote = (*it)[1];
+    std::smatch x, y, id;
+    if (!std::regex_search(mote, x, x_re) || !std::regex_search(mote, y, y_re) ||
+        !std::regex_search(mote, id, id_re))
+      continue; // plugin references such as <mote>0</mote>
+    by_id[std::stoi(id[1])] = {std::stod(x[1]), std::stod(y[1])};
+  }
+  if (by_id.empty())
+    throw std::runtime_error(file + ": no motes");
+
+  std::vector<Position> pos(by_id.rbegin()->first, Position{1e9, 1e9}); // unknown ids far away
+  for (auto &kv : by_id)
+    pos[kv.first - 1] = kv.second;
+  return pos;
+}
+
+std::vector<Position> grid_positions(int n, double spacing)
+{
+  int side = (int)std::ceil(std::sqrt((double)n));
+  std::vector<Position> pos;
+  for (int i = 0; i < side * side; i++)
+    pos.push_back({(i % side - side / 2) * spacing, (i / side - side / 2) * spacing});
+  std::stable_sort(pos.begin(), pos.end(), [](const Position &a, const Position &b) {
+    return std::hypot(a.x, a.y) < std::hypot(b.x, b.y);
+  });
+  pos.resize(n);
+  return pos;
+}
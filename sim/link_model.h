@@ -0,0 +1,59 @@
+/*
+ * Link models of the host simulator. A model is evaluated once at start-up
+ * into a per-sender list of links; frames then only look up that list.
+ */
+#ifndef LINK_MODEL_H_
+#define LINK_MODEL_H_
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Position {
+  double x, y;
+};
+
+struct Link {
+  int dst;     // receiver index (node id - 1)
+  double prr;  // reception probability of a collision-free frame, 0 = interference only
+  int rssi;    // dBm
+  double rssi_std; // per-frame RSSI standard deviation (trace replay)
+};
+
+class LinkModel {
+public:
+  virtual ~LinkModel() = default;
+  virtual const char *name() const = 0;
+  /* Links from node index src in a network of n nodes */
+  virtual std::vector<Link> links(int src, int n) const = 0;
+  /* Number of nodes the model describes, 0 if it works for any size */
+  virtual int nodes() const { return 0; }
+};
+
+/* Cooja Unit Disk Graph Medium: reception within range (with success
+ * ratios), interference up to interference range, linear RSSI */
+struct UdgmParams {
+  double range = 50.0;
+  double interference = 100.0;
+  double success_tx = 1.0;
+  double success_rx = 1.0;
+};
+std::unique_ptr<LinkModel> make_udgm(const std::vector<Position> &pos, const UdgmParams &p);
+
+/* Nodes on a line, each one hears only its direct neighbors */
+std::unique_ptr<LinkModel> make_line(double prr);
+
+/* Per-link PRR and RSSI read from a trace file, lines of:
+ *   <src id> <dst id> <prr> <rssi> [rssi std]
+ * '#' starts a comment. Missing links do not exist. */
+std::unique_ptr<LinkModel> make_trace(const std::string &file);
+
+/* Node positions and UDGM parameters from a Cooja .csc simulation file */
+std::vector<Position> load_csc(const std::string &file, UdgmParams *p);
+
+/* n nodes on a square grid, node 1 (the sink) in the center and ids
+ * growing with the distance from it */
+std::vector<Position> grid_positions(int n, double spacing);
+
+#endif /* LINK_MODEL_H_ */
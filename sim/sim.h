@@ -0,0 +1,48 @@
+/*
+ * Interface between the simulated node runtime (contiki-stubs.c, compiled
+ * together with the firmware sources into the per-node state) and the
+ * discrete-event simulator core (simulator.cpp).
+ */
+#ifndef SIM_H_
+#define SIM_H_
+/*---------------------------------------------------------------------------*/
+#include <stdint.h>
+#include "core/net/linkaddr.h"
+/*---------------------------------------------------------------------------*/
+#ifdef __cplusplus
+extern "C" {
+#endif
+/*---------------------------------------------------------------------------*/
+#define SIM_TIMER_ETIMER 0
+#define SIM_TIMER_CTIMER 1
+/* Transmission outcomes, same values as MAC_TX_* */
+#define SIM_TX_OK 0
+#define SIM_TX_COLLISION 1
+#define SIM_TX_NOACK 2
+/*---------------------------------------------------------------------------*/
+/* Simulator services, always refer to the node currently running */
+uint64_t sim_now_us(void);
+void sim_timer_schedule(void *timer, uint32_t gen, uint8_t kind, uint64_t at_us);
+void sim_radio_set(int on);
+void sim_radio_channel(int channel); // IEEE 802.15.4 channel, 11 to 26
+int sim_radio_get_channel(void);
+void sim_radio_send(uint16_t channel, const linkaddr_t *dest,
+                    const uint8_t *frame, uint16_t len);
+unsigned long sim_energest(int type);
+uint8_t *sim_flash(uint32_t size); // flash image of the node, erased on first use
+uint32_t sim_seed(void);
+int sim_printf(const char *fmt, ...) __attribute__((format(__printf__, 1, 2)));
+/*---------------------------------------------------------------------------*/
+/* Node runtime entry points, called with the node state switched in */
+void sim_node_boot(uint16_t id);
+void sim_node_timer(void *timer, uint32_t gen, uint8_t kind);
+void sim_node_input(uint16_t channel, const linkaddr_t *sender,
+                    const uint8_t *frame, uint16_t len, int16_t rssi);
+void sim_node_sent(uint16_t channel, int status, int num_tx);
+void sim_node_serial(const char *line);
+/*---------------------------------------------------------------------------*/
+#ifdef __cplusplus
+}
+#endif
+/*---------------------------------------------------------------------------*/
+#endif /* SIM_H_ */
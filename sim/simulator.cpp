@@ -0,0 +1,851 @@
+/*
+ * Discrete-event simulator for the scheduled data collection.
+ *
+ * Every node runs the unmodified firmware (app.c, sched_collect.c, ...)
+ * linked against the Contiki runtime of contiki-stubs.c. All static data
+ * of that code is gathered in the node_state section (node-state.ld):
+ * each node owns a copy of it, swapped in before the simulator calls into
+ * the node. The output has the format of a Cooja no-GUI log, so
+ * parse-stats.py works on it unchanged.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "link_model.h"
+#include "sim.h"
+
+extern "C" uint8_t __start_node_state[], __stop_node_state[];
+
+namespace {
+
+/* IEEE 802.15.4 at 250 kbps */
+const uint64_t BYTE_US = 32;
+const uint16_t FRAME_OVERHEAD = 6 + 11 + 2; // PHY header, MAC header, FCS
+const uint64_t ACK_US = 192 + 11 * BYTE_US; // turnaround + ACK frame
+const uint64_t BACKOFF_US = 320;            // CSMA unit backoff period
+const int MAC_MAX_TX = 3;                   // transmissions of a unicast frame
+const int MAC_MAX_BACKOFFS = 5;             // busy channel assessments before drop
+const int RADIO_CHANNELS = 27;              // IEEE 802.15.4 channels 11 to 26
+const int DEFAULT_CHANNEL = 26;
+const uint64_t SYNC_MATCH_US = 5000000;    // beacons further from the epoch start are from another sink boot
+
+struct Frame {
+  uint16_t channel;
+  int dest; // -1 for broadcast
+  std::vector<uint8_t> data;
+  uint8_t seq;
+  int tx = 0;
+  int backoffs = 0;
+};
+
+struct Reception {
+  int rx;
+  int rssi;
+  double prr;
+  bool ok;
+};
+
+struct Tx {
+  int src;
+  uint32_t boots;               // of the sender when it started the frame
+  int radio_channel;
+  Frame frame;
+  std::vector<int> signal;      // nodes the signal reaches (incl. interference)
+  std::vector<Reception> rx;    // nodes that may decode it
+};
+
+struct Node {
+  uint16_t id;
+  std::vector<uint8_t> state;
+  std::vector<Link> links;
+  bool booted = false;
+  uint32_t boots = 0; // reboots so far, the timer and MAC events of a previous boot are dropped
+  bool sink = false;
+  uint64_t boot_us = 0;
+  bool radio_on = false;
+  uint64_t on_since = 0;
+  uint64_t on_us = 0;    // radio on time, tx excluded
+  uint64_t tx_us = 0;
+  uint64_t tx_until = 0;
+  int channel = DEFAULT_CHANNEL;
+  int incoming[RADIO_CHANNELS] = {}; // signals currently arriving, per channel
+  std::set<uint32_t> receiving;
+  std::deque<Frame> mac_queue;
+  bool mac_busy = false;
+  uint8_t mac_seq = 0;
+  std::unordered_map<int, uint8_t> last_seq; // duplicate filter
+  std::vector<uint8_t> flash;
+  std::vector<std::pair<uint64_t, uint64_t>> outages; // radio cut off in [from, to)
+  std::string line;
+  /* statistics (see Summary) */
+  std::map<uint16_t, uint64_t> sent; // by seqn: time queued
+  std::map<uint16_t, uint64_t> alarms; // urgent packets by seqn: time raised
+  unsigned long clock_second = 0;
+  double sync_err_sum = 0, sync_err_max = 0; // us
+  unsigned long sync_count = 0;
+  unsigned long missed = 0; // epochs without a beacon, of a synchronized node
+};
+
+enum EventKind { EV_BOOT, EV_TIMER, EV_MAC, EV_TX_END, EV_SERIAL, EV_REBOOT };
+
+struct Event {
+  uint64_t t;
+  uint64_t seq;
+  EventKind kind;
+  int node;
+  void *timer;
+  uint32_t gen;
+  uint8_t tkind;
+  uint32_t idx;
+  bool operator>(const Event &o) const { return t != o.t ? t > o.t : seq > o.seq; }
+};
+
+struct Options {
+  int nodes = 0;
+  double duration = 1800;
+  uint32_t seed = 123457;
+  double boot_jitter = 1.0;
+  double sync_from = 0; // s, sync error of the beacons received after it
+  std::string topology = "udgm";
+  std::string csc, trace, log = "-";
+  double grid = 40.0;
+  UdgmParams udgm;
+  double line_prr = 1.0;
+  std::vector<std::pair<double, std::string>> input;
+  struct Outage {
+    int id;
+    double from, to;
+  };
+  std::vector<Outage> outages;
+  std::vector<std::pair<int, double>> reboots; // node id, time
+  std::map<int, double> channel_loss; // extra loss (e.g. Wi-Fi) per channel
+  double min_pdr = -1;
+  bool quiet = false;
+  std::string json;
+};
+
+/* End of run figures, see Simulator::summary() */
+struct Results {
+  unsigned long sent = 0, recv = 0;
+  double pdr = 0, dc_avg = 0, dc_max = 0;
+  double sync_avg_ms = 0, sync_max_ms = 0;
+  unsigned long missed = 0; // beacons missed by synchronized nodes
+  double latency_avg_s = 0, latency_max_s = 0; // regular packets: age of their first reading
+  unsigned long alarms = 0, alarms_recv = 0;
+  double alarm_avg_s = 0, alarm_max_s = 0;
+};
+
+class Simulator {
+public:
+  Simulator(const Options &opt, std::unique_ptr<LinkModel> model, int n);
+  ~Simulator();
+  void run();
+  int summary();
+  void write_json(const std::string &file, double wall) const;
+
+  /* sim.h services */
+  uint64_t now() const { return now_; }
+  void schedule_timer(void *timer, uint32_t gen, uint8_t kind, uint64_t at);
+  void radio_set(bool on);
+  void radio_channel(int channel);
+  int radio_get_channel() const { return nodes_[current_].channel; }
+  void radio_send(uint16_t channel, const linkaddr_t *dest, const uint8_t *frame, uint16_t len);
+  unsigned long energest(int type);
+  uint8_t *flash(uint32_t size);
+  uint32_t seed() const { return opt_.seed; }
+  void output(const char *s);
+
+private:
+  void push(Event e);
+  void push_mac(int n, uint64_t at);
+  void switch_to(int n);
+  void reboot(int n);
+  void mac_attempt(int n);
+  void tx_end(uint32_t id);
+  void tx_done(int n, const Frame &f, int status);
+  void lose_receptions(Node &node, int n);
+  bool down(const Node &node) const;
+  void log_line(Node &node, const std::string &line);
+  uint64_t radio_time(const Node &node) const;
+
+  Options opt_;
+  std::unique_ptr<LinkModel> model_;
+  std::vector<Node> nodes_;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> queue_;
+  std::unordered_map<uint32_t, Tx> txs_;
+  uint32_t next_tx_ = 0;
+  uint64_t seq_ = 0;
+  uint64_t now_ = 0;
+  uint64_t events_ = 0;
+  int current_ = -1;
+  std::mt19937_64 rng_;
+  FILE *log_ = nullptr;
+  size_t state_size_;
+  std::vector<uint8_t> pristine_; // static data of a node at power up
+  /* delivered (src, seqn): time of the first reception, from the sink log */
+  std::map<std::pair<int, int>, uint64_t> recv_;
+  /* alarm latency (us) by (src, seqn), from the sink log */
+  std::map<std::pair<int, int>, uint64_t> alarm_recv_;
+  /* start of the epochs by seqn: first beacon of a sink */
+  std::map<unsigned, uint64_t> epoch_start_;
+  Results results_;
+};
+
+Simulator *sim;
+
+Simulator::Simulator(const Options &opt, std::unique_ptr<LinkModel> model, int n)
+    : opt_(opt), model_(std::move(model)), rng_(opt.seed)
+{
+  state_size_ = __stop_node_state - __start_node_state;
+  pristine_.assign(__start_node_state, __stop_node_state);
+  std::uniform_real_distribution<double> boot(0.0, opt.boot_jitter);
+
+  nodes_.resize(n);
+  for (int i = 0; i < n; i++) {
+    Node &node = nodes_[i];
+    node.id = i + 1;
+    node.state = pristine_;
+    node.links = model_->links(i, n);
+    for (const Options::Outage &o : opt.outages)
+      if (o.id == node.id)
+        node.outages.push_back({(uint64_t)(o.from * 1e6), (uint64_t)(o.to * 1e6)});
+    push({(uint64_t)(boot(rng_) * 1e6), 0, EV_BOOT, i, nullptr, 0, 0, 0});
+  }
+  for (size_t i = 0; i < opt.input.size(); i++)
+    push({(uint64_t)(opt.input[i].first * 1e6), 0, EV_SERIAL, 0, nullptr, 0, 0, (uint32_t)i});
+  for (const auto &r : opt.reboots)
+    if (r.first >= 1 && r.first <= n)
+      push({(uint64_t)(r.second * 1e6), 0, EV_REBOOT, r.first - 1, nullptr, 0, 0, 0});
+
+  if (opt.quiet)
+    log_ = nullptr;
+  else if (opt.log == "-")
+    log_ = stdout;
+  else if (!(log_ = fopen(opt.log.c_str(), "w")))
+    throw std::runtime_error("cannot open " + opt.log);
+}
+
+Simulator::~Simulator()
+{
+  if (log_ && log_ != stdout)
+    fclose(log_);
+}
+
+void Simulator::push(Event e)
+{
+  e.seq = seq_++;
+  queue_.push(e);
+}
+
+void Simulator::push_mac(int n, uint64_t at)
+{
+  push({at, 0, EV_MAC, n, nullptr, 0, 0, nodes_[n].boots});
+}
+
+/* Make node n's static data the live one */
+void Simulator::switch_to(int n)
+{
+  if (current_ == n)
+    return;
+  if (current_ >= 0)
+    memcpy(nodes_[current_].state.data(), __start_node_state, state_size_);
+  memcpy(__start_node_state, nodes_[n].state.data(), state_size_);
+  current_ = n;
+}
+
+void Simulator::run()
+{
+  const uint64_t end = (uint64_t)(opt_.duration * 1e6);
+
+  while (!queue_.empty() && queue_.top().t <= end) {
+    Event e = queue_.top();
+    queue_.pop();
+    now_ = e.t;
+    events_++;
+    Node &node = nodes_[e.node];
+
+    switch (e.kind) {
+    case EV_BOOT:
+      switch_to(e.node);
+      node.booted = true;
+      node.boot_us = now_;
+      sim_node_boot(node.id);
+      break;
+    case EV_TIMER:
+      if (e.idx != node.boots)
+        break;
+      switch_to(e.node);
+      sim_node_timer(e.timer, e.gen, e.tkind);
+      break;
+    case EV_MAC:
+      if (e.idx == node.boots)
+        mac_attempt(e.node);
+      break;
+    case EV_TX_END:
+      tx_end(e.idx);
+      break;
+    case EV_SERIAL:
+      if (node.booted) {
+        switch_to(e.node);
+        sim_node_serial(opt_.input[e.idx].second.c_str());
+      }
+      break;
+    case EV_REBOOT:
+      if (node.booted)
+        reboot(e.node);
+      break;
+    }
+  }
+  now_ = end;
+}
+
+/* Power cycle node n: its static data starts over, its flash is kept */
+void Simulator::reboot(int n)
+{
+  Node &node = nodes_[n];
+
+  switch_to(n);
+  radio_set(false);
+  radio_channel(DEFAULT_CHANNEL);
+  node.boots++;
+  node.mac_queue.clear();
+  node.mac_busy = false;
+  node.line.clear();
+  memcpy(__start_node_state, pristine_.data(), state_size_);
+  sim_node_boot(node.id);
+}
+
+void Simulator::schedule_timer(void *timer, uint32_t gen, uint8_t kind, uint64_t at)
+{
+  push({std::max(at, now_), 0, EV_TIMER, current_, timer, gen, kind, nodes_[current_].boots});
+}
+
+void Simulator::radio_set(bool on)
+{
+  Node &node = nodes_[current_];
+  if (on == node.radio_on)
+    return;
+  if (on) {
+    node.on_since = now_;
+  } else {
+    node.on_us += now_ - node.on_since;
+    lose_receptions(node, current_);
+  }
+  node.radio_on = on;
+}
+
+void Simulator::radio_channel(int channel)
+{
+  Node &node = nodes_[current_];
+  if (channel == node.channel)
+    return;
+  lose_receptions(node, current_);
+  node.channel = channel;
+}
+
+/* Frames node n is receiving are lost */
+void Simulator::lose_receptions(Node &node, int n)
+{
+  for (uint32_t id : node.receiving)
+    for (Reception &r : txs_[id].rx)
+      if (r.rx == n)
+        r.ok = false;
+  node.receiving.clear();
+}
+
+void Simulator::radio_send(uint16_t channel, const linkaddr_t *dest, const uint8_t *frame, uint16_t len)
+{
+  Node &node = nodes_[current_];
+  Frame f;
+  f.channel = channel;
+  f.dest = dest ? (dest->u8[0] | dest->u8[1] << 8) - 1 : -1;
+  f.data.assign(frame, frame + len);
+  f.seq = node.mac_seq++;
+  node.mac_queue.push_back(std::move(f));
+  if (!node.mac_busy) {
+    node.mac_busy = true;
+    push_mac(current_, now_);
+  }
+}
+
+/* CSMA: transmit the head of the MAC queue if the channel is clear */
+void Simulator::mac_attempt(int n)
+{
+  Node &node = nodes_[n];
+  if (node.mac_queue.empty()) {
+    node.mac_busy = false;
+    return;
+  }
+  Frame &f = node.mac_queue.front();
+
+  if (node.incoming[node.channel] > 0 || node.tx_until > now_) {
+    if (++f.backoffs > MAC_MAX_BACKOFFS) {
+      Frame dropped = std::move(f);
+      node.mac_queue.pop_front();
+      push_mac(n, now_);
+      tx_done(n, dropped, SIM_TX_COLLISION);
+      return;
+    }
+    uint64_t slots = std::uniform_int_distribution<uint64_t>(1, 1ull << std::min(f.backoffs + 2, 5))(rng_);
+    push_mac(n, now_ + slots * BACKOFF_US);
+    return;
+  }
+
+  uint64_t airtime = (f.data.size() + FRAME_OVERHEAD) * BYTE_US;
+  uint32_t id = next_tx_++;
+  Tx &tx = txs_[id];
+  tx.src = n;
+  tx.boots = node.boots;
+  tx.radio_channel = node.channel;
+  tx.frame = f;
+  tx.frame.tx++;
+  f.tx++;
+
+  /* half duplex: whatever the sender was receiving is lost */
+  lose_receptions(node, n);
+  node.tx_until = now_ + airtime;
+  node.tx_us += airtime;
+
+  for (const Link &l : node.links) {
+    Node &dst = nodes_[l.dst];
+    if (!dst.booted || down(node) || down(dst))
+      continue;
+    tx.signal.push_back(l.dst);
+    /* only signals on the same channel interfere */
+    bool collision = dst.incoming[node.channel]++ > 0;
+    if (collision && dst.channel == node.channel) // every overlapping frame is lost
+      lose_receptions(dst, l.dst);
+    if (l.prr > 0 && dst.radio_on && dst.channel == node.channel && dst.tx_until <= now_) {
+      int rssi = l.rssi;
+      if (l.rssi_std > 0)
+        rssi = (int)std::lround(std::normal_distribution<double>(l.rssi, l.rssi_std)(rng_));
+      tx.rx.push_back({l.dst, rssi, l.prr, !collision});
+      dst.receiving.insert(id);
+    }
+  }
+  push({now_ + airtime, 0, EV_TX_END, n, nullptr, 0, 0, id});
+}
+
+void Simulator::tx_end(uint32_t id)
+{
+  Tx tx = std::move(txs_[id]);
+  txs_.erase(id);
+  Node &src = nodes_[tx.src];
+  linkaddr_t sender = {{(uint8_t)(src.id & 0xff), (uint8_t)(src.id >> 8)}};
+  std::uniform_real_distribution<double> coin(0.0, 1.0);
+  bool acked = false;
+  auto loss = opt_.channel_loss.find(tx.radio_channel);
+  double clear = loss != opt_.channel_loss.end() ? 1.0 - loss->second : 1.0;
+
+  for (int n : tx.signal)
+    nodes_[n].incoming[tx.radio_channel]--;
+
+  for (const Reception &r : tx.rx) {
+    Node &dst = nodes_[r.rx];
+    dst.receiving.erase(id);
+    if (!r.ok || !dst.radio_on || coin(rng_) >= r.prr * clear)
+      continue;
+    if (tx.frame.dest >= 0 && tx.frame.dest != r.rx)
+      continue; // address filter
+    if (tx.frame.dest >= 0) {
+      acked = coin(rng_) < r.prr * clear; // the ACK crosses the same link
+      auto last = dst.last_seq.find(tx.src);
+      if (last != dst.last_seq.end() && last->second == tx.frame.seq)
+        continue; // retransmission of a frame already delivered
+      dst.last_seq[tx.src] = tx.frame.seq;
+    }
+    switch_to(r.rx);
+    sim_node_input(tx.frame.channel, &sender, tx.frame.data.data(),
+                   (uint16_t)tx.frame.data.size(), (int16_t)r.rssi);
+  }
+
+  if (tx.boots != src.boots) // the sender rebooted meanwhile, its MAC state is gone
+    return;
+  Frame &head = src.mac_queue.front();
+  if (tx.frame.dest >= 0 && !acked && head.tx < MAC_MAX_TX) {
+    head.backoffs = 0; // retransmit after the ACK timeout and a random backoff
+    uint64_t slots = std::uniform_int_distribution<uint64_t>(1, 1ull << std::min(head.tx + 2, 5))(rng_);
+    push_mac(tx.src, now_ + ACK_US + slots * BACKOFF_US);
+    return;
+  }
+  src.mac_queue.pop_front();
+  push_mac(tx.src, now_ + (tx.frame.dest >= 0 ? ACK_US : 0));
+  tx_done(tx.src, tx.frame, tx.frame.dest >= 0 && !acked ? SIM_TX_NOACK : SIM_TX_OK);
+}
+
+/* Report the outcome of a frame to the Rime sent callback */
+void Simulator::tx_done(int n, const Frame &f, int status)
+{
+  switch_to(n);
+  sim_node_sent(f.channel, status, f.tx);
+}
+
+bool Simulator::down(const Node &node) const
+{
+  for (const auto &o : node.outages)
+    if (now_ >= o.first && now_ < o.second)
+      return true;
+  return false;
+}
+
+uint64_t Simulator::radio_time(const Node &node) const
+{
+  return node.on_us + (node.radio_on ? now_ - node.on_since : 0);
+}
+
+unsigned long Simulator::energest(int type)
+{
+  const Node &node = nodes_[current_];
+  uint64_t us = 0, tx = std::min(node.tx_us, radio_time(node));
+  switch (type) {
+  case 0: us = 0; break;                                // ENERGEST_TYPE_CPU: not modelled
+  case 1: us = now_ - node.boot_us; break;              // ENERGEST_TYPE_LPM
+  case 2: us = node.tx_us; break;                       // ENERGEST_TYPE_TRANSMIT
+  case 3: us = radio_time(node) - tx; break;            // ENERGEST_TYPE_LISTEN
+  }
+  return (unsigned long)(us * 32768 / 1000000);
+}
+
+uint8_t *Simulator::flash(uint32_t size)
+{
+  Node &node = nodes_[current_];
+  if (node.flash.size() < size)
+    node.flash.resize(size, 0);
+  return node.flash.data();
+}
+
+void Simulator::output(const char *s)
+{
+  Node &node = nodes_[current_];
+  for (; *s; s++) {
+    if (*s != '\n') {
+      node.line += *s;
+      continue;
+    }
+    log_line(node, node.line);
+    node.line.clear();
+  }
+}
+
+void Simulator::log_line(Node &node, const std::string &line)
+{
+  unsigned a, b, seqn, metric, delay;
+  unsigned long cs;
+  int rssi;
+
+  if (log_)
+    fprintf(log_, "%" PRIu64 "\tID:%u\t%s\n", now_, node.id, line.c_str());
+
+  /* Sync error: epoch start a beacon tells (reception - embedded delay)
+   * against the time the sink started the epoch */
+  if (sscanf(line.c_str(), "collect: sending beacon: seqn %u metric %u", &seqn, &metric) == 2 &&
+      metric == 0) {
+    auto it = epoch_start_.find(seqn);
+    if (it == epoch_start_.end() || now_ - it->second > SYNC_MATCH_US)
+      epoch_start_[seqn] = now_;
+  } else if (sscanf(line.c_str(), "collect: recv beacon from %x:%x, seqn %u, metric %u, rssi %d, delay %u",
+                    &a, &b, &seqn, &metric, &rssi, &delay) == 6 && !node.sink && node.clock_second &&
+             now_ >= (uint64_t)(opt_.sync_from * 1e6)) {
+    auto it = epoch_start_.find(seqn);
+    double err = it == epoch_start_.end() ? -1 :
+        std::fabs((double)now_ - (double)delay * 1e6 / node.clock_second - (double)it->second);
+    if (err >= 0 && err < SYNC_MATCH_US) { // else a beacon of an earlier sink boot
+      node.sync_err_sum += err;
+      node.sync_err_max = std::max(node.sync_err_max, err);
+      node.sync_count++;
+    }
+  }
+
+  /* mirror parse-stats.py for the end of run summary */
+  if (sscanf(line.c_str(), "CLOCK_SECOND: %lu", &cs) == 1)
+    node.clock_second = cs;
+  else if (line.compare(0, 14, "App: I am sink") == 0)
+    node.sink = true;
+  else if (line.compare(0, 22, "collect: missed beacon") == 0 || line.compare(0, 18, "collect: lost sync") == 0)
+    node.missed++;
+  else if (sscanf(line.c_str(), "App: Send seqn %u", &seqn) == 1)
+    node.sent[seqn] = now_;
+  else if (sscanf(line.c_str(), "App: Recv from %x:%x seqn %u", &a, &b, &seqn) == 3)
+    recv_.emplace(std::make_pair((int)(a | b << 8), (int)seqn), now_);
+  else if (sscanf(line.c_str(), "App: Alarm seqn %u", &seqn) == 1)
+    node.alarms[seqn] = now_;
+  else if (sscanf(line.c_str(), "App: Alarm from %x:%x seqn %u", &a, &b, &seqn) == 3) {
+    int src = a | b << 8;
+    if (src >= 1 && src <= (int)nodes_.size() && nodes_[src - 1].alarms.count(seqn))
+      alarm_recv_.emplace(std::make_pair(src, (int)seqn), now_ - nodes_[src - 1].alarms[seqn]);
+  }
+}
+
+/* Print PDR, duty cycle and sync error, returns non-zero if a check failed */
+int Simulator::summary()
+{
+  unsigned long sent = 0, recv = 0, sync_count = 0, alarms = 0, missed = 0;
+  double dc_sum = 0, dc_max = 0, sync_sum = 0, sync_max = 0, latency_sum = 0, latency_max = 0;
+  int dc_nodes = 0;
+
+  for (const Node &node : nodes_) {
+    if (!node.booted || node.sink)
+      continue;
+    /* like parse-stats.py: drop the first and the last seqn */
+    if (node.sent.size() > 2)
+      for (auto it = std::next(node.sent.begin()); it != std::prev(node.sent.end()); ++it) {
+        sent++;
+        auto r = recv_.find({node.id, it->first});
+        if (r == recv_.end())
+          continue;
+        recv++;
+        double age = ((double)r->second - (double)std::prev(it)->second) / 1e6; // from the first reading
+        latency_sum += age;
+        latency_max = std::max(latency_max, age);
+      }
+    uint64_t on = radio_time(node);
+    double dc = 100.0 * (double)(on - std::min(on, node.tx_us) + node.tx_us) / (double)(now_ - node.boot_us);
+    dc_sum += dc;
+    dc_max = std::max(dc_max, dc);
+    dc_nodes++;
+    sync_sum += node.sync_err_sum;
+    sync_max = std::max(sync_max, node.sync_err_max);
+    sync_count += node.sync_count;
+    missed += node.missed;
+    alarms += node.alarms.size();
+  }
+  double alarm_sum = 0, alarm_max = 0;
+  for (const auto &a : alarm_recv_) {
+    alarm_sum += a.second / 1e6;
+    alarm_max = std::max(alarm_max, a.second / 1e6);
+  }
+
+  double pdr = sent ? 100.0 * recv / sent : 0.0;
+  results_.sent = sent;
+  results_.recv = recv;
+  results_.pdr = pdr;
+  results_.dc_avg = dc_nodes ? dc_sum / dc_nodes : 0.0;
+  results_.dc_max = dc_max;
+  results_.sync_avg_ms = sync_count ? sync_sum / sync_count / 1000 : 0.0;
+  results_.sync_max_ms = sync_max / 1000;
+  results_.missed = missed;
+  results_.latency_avg_s = recv ? latency_sum / recv : 0.0;
+  results_.latency_max_s = latency_max;
+  results_.alarms = alarms;
+  results_.alarms_recv = alarm_recv_.size();
+  results_.alarm_avg_s = alarm_recv_.empty() ? 0.0 : alarm_sum / alarm_recv_.size();
+  results_.alarm_max_s = alarm_max;
+  fprintf(stderr, "sim: %zu nodes (%s), %.0f s simulated, %" PRIu64 " events\n",
+          nodes_.size(), model_->name(), opt_.duration, events_);
+  fprintf(stderr, "sim: PDR %.2f%% (%lu/%lu)\n", pdr, recv, sent);
+  fprintf(stderr, "sim: duty cycle avg %.3f%% max %.3f%%\n", results_.dc_avg, dc_max);
+  fprintf(stderr, "sim: sync error avg %.3f ms max %.3f ms, %lu missed beacons\n",
+          results_.sync_avg_ms, results_.sync_max_ms, missed);
+  fprintf(stderr, "sim: latency avg %.3f s max %.3f s\n", results_.latency_avg_s, latency_max);
+  if (alarms)
+    fprintf(stderr, "sim: alarms %lu/%lu, latency avg %.3f s max %.3f s\n",
+            results_.alarms_recv, alarms, results_.alarm_avg_s, alarm_max);
+
+  if (opt_.min_pdr >= 0 && pdr < opt_.min_pdr) {
+    fprintf(stderr, "sim: FAIL PDR below %.2f%%\n", opt_.min_pdr);
+    return 1;
+  }
+  return 0;
+}
+
+/* Machine-readable summary, for the benchmarks (bench.py) */
+void Simulator::write_json(const std::string &file, double wall) const
+{
+  FILE *f = file == "-" ? stdout : fopen(file.c_str(), "w");
+  if (!f)
+    throw std::runtime_error("cannot open " + file);
+  fprintf(f, "{\"nodes\": %zu, \"topology\": \"%s\", \"duration\": %.0f, \"seed\": %u, "
+          "\"events\": %" PRIu64 ", \"wall_s\": %.3f, \"sent\": %lu, \"recv\": %lu, "
+          "\"pdr\": %.3f, \"dc_avg\": %.4f, \"dc_max\": %.4f, "
+          "\"sync_err_avg_ms\": %.3f, \"sync_err_max_ms\": %.3f, \"missed\": %lu, "
+          "\"latency_avg_s\": %.3f, \"latency_max_s\": %.3f, "
+          "\"alarms\": %lu, \"alarms_recv\": %lu, \"alarm_avg_s\": %.3f, \"alarm_max_s\": %.3f}\n",
+          nodes_.size(), model_->name(), opt_.duration, opt_.seed, events_, wall,
+          results_.sent, results_.recv, results_.pdr, results_.dc_avg, results_.dc_max,
+          results_.sync_avg_ms, results_.sync_max_ms, results_.missed,
+          results_.latency_avg_s, results_.latency_max_s,
+          results_.alarms, results_.alarms_recv, results_.alarm_avg_s, results_.alarm_max_s);
+  if (f != stdout)
+    fclose(f);
+}
+
+void usage()
+{
+  fprintf(stderr,
+          "usage: sched-collect-sim [options]\n"
+          "  --nodes N            number of nodes, node 1 is the sink (see SINKS)\n"
+          "  --duration S         simulated seconds (default 1800)\n"
+          "  --seed S             random seed (default 123457)\n"
+          "  --boot-jitter S      nodes boot at random in [0, S) s (default 1)\n"
+          "  --sync-from S        sync error of the beacons received from S s on (default 0)\n"
+          "  --topology T         udgm (default), line or trace\n"
+          "  --csc FILE           udgm: positions and parameters from a Cooja .csc\n"
+          "  --grid D             udgm: square grid with spacing D m (default 40)\n"
+          "  --range R            udgm: transmission range (default 50)\n"
+          "  --interference R     udgm: interference range (default 100)\n"
+          "  --success-tx P       udgm: success ratio tx (default 1)\n"
+          "  --success-rx P       udgm: success ratio rx (default 1)\n"
+          "  --line-prr P         line: delivery ratio of each hop (default 1)\n"
+          "  --trace FILE         trace: link trace, e.g. from link-trace.py\n"
+          "  --input T:LINE       serial line to the sink at T s (repeatable)\n"
+          "  --outage ID:FROM:TO  node ID neither sends nor receives from FROM to TO s\n"
+          "  --reboot ID:T        node ID restarts at T s, keeping its flash (repeatable)\n"
+          "  --channel-loss CH:P  frames on channel CH are lost with probability P\n"
+          "  --log FILE           Cooja-style log (default stdout)\n"
+          "  --quiet              no log\n"
+          "  --json FILE          end of run figures as JSON\n"
+          "  --min-pdr P          exit with failure if the PDR is below P %%\n");
+}
+
+Options parse_args(int argc, char **argv)
+{
+  Options o;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    auto val = [&]() -> std::string {
+      if (i + 1 >= argc)
+        throw std::runtime_error("missing value for " + a);
+      return argv[++i];
+    };
+    if (a == "--nodes") o.nodes = std::stoi(val());
+    else if (a == "--duration") o.duration = std::stod(val());
+    else if (a == "--seed") o.seed = (uint32_t)std::stoul(val());
+    else if (a == "--boot-jitter") o.boot_jitter = std::stod(val());
+    else if (a == "--sync-from") o.sync_from = std::stod(val());
+    else if (a == "--topology") o.topology = val();
+    else if (a == "--csc") o.csc = val();
+    else if (a == "--grid") o.grid = std::stod(val());
+    else if (a == "--range") o.udgm.range = std::stod(val());
+    else if (a == "--interference") o.udgm.interference = std::stod(val());
+    else if (a == "--success-tx") o.udgm.success_tx = std::stod(val());
+    else if (a == "--success-rx") o.udgm.success_rx = std::stod(val());
+    else if (a == "--line-prr") o.line_prr = std::stod(val());
+    else if (a == "--trace") {
+      o.trace = val();
+      o.topology = "trace";
+    } else if (a == "--log") o.log = val();
+    else if (a == "--quiet") o.quiet = true;
+    else if (a == "--json") o.json = val();
+    else if (a == "--min-pdr") o.min_pdr = std::stod(val());
+    else if (a == "--input") {
+      std::string v = val();
+      size_t colon = v.find(':');
+      if (colon == std::string::npos)
+        throw std::runtime_error("--input expects T:LINE");
+      o.input.push_back({std::stod(v.substr(0, colon)), v.substr(colon + 1)});
+    } else if (a == "--outage") {
+      Options::Outage out;
+      if (sscanf(val().c_str(), "%d:%lf:%lf", &out.id, &out.from, &out.to) != 3)
+        throw std::runtime_error("--outage expects ID:FROM:TO");
+      o.outages.push_back(out);
+    } else if (a == "--reboot") {
+      int id;
+      double t;
+      if (sscanf(val().c_str(), "%d:%lf", &id, &t) != 2)
+        throw std::runtime_error("--reboot expects ID:T");
+      o.reboots.push_back({id, t});
+    } else if (a == "--channel-loss") {
+      int ch;
+      double p;
+      if (sscanf(val().c_str(), "%d:%lf", &ch, &p) != 2 || ch < 11 || ch > 26 || p < 0 || p > 1)
+        throw std::runtime_error("--channel-loss expects CH:P, CH in [11, 26], P in [0, 1]");
+      o.channel_loss[ch] = p;
+    } else if (a == "-h" || a == "--help") {
+      usage();
+      exit(0);
+    } else
+      throw std::runtime_error("unknown option " + a);
+  }
+  return o;
+}
+
+} // namespace
+
+/*---------------------------------------------------------------------------*/
+/* sim.h */
+extern "C" {
+uint64_t sim_now_us(void) { return sim->now(); }
+void sim_timer_schedule(void *timer, uint32_t gen, uint8_t kind, uint64_t at_us)
+{
+  sim->schedule_timer(timer, gen, kind, at_us);
+}
+void sim_radio_set(int on) { sim->radio_set(on != 0); }
+void sim_radio_channel(int channel) { sim->radio_channel(channel); }
+int sim_radio_get_channel(void) { return sim->radio_get_channel(); }
+void sim_radio_send(uint16_t channel, const linkaddr_t *dest, const uint8_t *frame, uint16_t len)
+{
+  sim->radio_send(channel, dest, frame, len);
+}
+unsigned long sim_energest(int type) { return sim->energest(type); }
+uint8_t *sim_flash(uint32_t size) { return sim->flash(size); }
+uint32_t sim_seed(void) { return sim->seed(); }
+int sim_printf(const char *fmt, ...)
+{
+  char buf[512];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  sim->output(buf);
+  return n;
+}
+}
+/*---------------------------------------------------------------------------*/
+int main(int argc, char **argv)
+{
+  try {
+    Options opt = parse_args(argc, argv);
+    std::unique_ptr<LinkModel> model;
+    int n = opt.nodes;
+
+    if (opt.topology == "udgm") {
+      std::vector<Position> pos;
+      if (!opt.csc.empty())
+        pos = load_csc(opt.csc, &opt.udgm);
+      else
+        pos = grid_positions(n > 0 ? n : 9, opt.grid);
+      model = make_udgm(pos, opt.udgm);
+    } else if (opt.topology == "line") {
+      model = make_line(opt.line_prr);
+    } else if (opt.topology == "trace") {
+      if (opt.trace.empty())
+        throw std::runtime_error("--topology trace needs --trace FILE");
+      model = make_trace(opt.trace);
+    } else
+      throw std::runtime_error("unknown topology " + opt.topology);
+
+    if (n == 0)
+      n = model->nodes() ? model->nodes() : 9;
+    if (n < 2 || n > 255)
+      throw std::runtime_error("--nodes must be in [2, 255]");
+
+    auto start = std::chrono::steady_clock::now();
+    Simulator s(opt, std::move(model), n);
+    sim = &s;
+    s.run();
+    int ret = s.summary();
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    fprintf(stderr, "sim: wall time %.2f s\n", wall.count());
+    if (!opt.json.empty())
+      s.write_json(opt.json, wall.count());
+    return ret;
+  } catch (const std::exception &e) {
+    fprintf(stderr, "sim: %s\n", e.what());
+    return 2;
+  }
+}
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+#include "sink_stats.h"
+/*---------------------------------------------------------------------------*/
+#define SEQN_DIFF(a, b) ((int16_t)((uint16_t)(a) - (uint16_t)(b)))
+/*---------------------------------------------------------------------------*/
+static struct sink_stats_entry table[MAX_NODES];
+typedef char sink_stats_ram_underestimated[sizeof(table) <= SINK_STATS_RAM ? 1 : -1];
+static const struct sched_collect_conn *stats_conn;
+static struct ctimer summary_timer;
+static uint16_t summary_cnt;
+/*---------------------------------------------------------------------------*/
+static void summary_cb(void *p);
+/*---------------------------------------------------------------------------*/
+static struct sink_stats_entry *lookup(const linkaddr_t *src, bool create)
+{
+  struct sink_stats_entry *free_entry = NULL;
+  uint8_t i;
+
+  for (i = 0; i < MAX_NODES; i++)
+  {
+    if (linkaddr_cmp(&table[i].addr, src))
+      return &table[i];
+    if (free_entry == NULL && linkaddr_cmp(&table[i].addr, &linkaddr_null))
+      free_entry = &table[i];
+  }
+
+  if (create && free_entry != NULL)
+  {
+    linkaddr_copy(&free_entry->addr, src);
+    return free_entry;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+void sink_stats_init(const struct sched_collect_conn *conn)
+{
+  uint8_t i;
+
+  stats_conn = conn;
+  for (i = 0; i < MAX_NODES; i++)
+    linkaddr_copy(&table[i].addr, &linkaddr_null);
+  summary_cnt = 0;
+
+  /* Report in the middle of the epoch, after the collection window */
+  ctimer_set(&summary_timer, EPOCH_DURATION / 2, summary_cb, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void sink_stats_update(const linkaddr_t *src, uint16_t seqn, uint8_t hops)
+{
+  struct sink_stats_entry *e = lookup(src, true);
+  int16_t gap;
+
+  if (e == NULL)
+  {
+    printf("Stats: table full, %02x:%02x not tracked\n", src->u8[0], src->u8[1]);
+    return;
+  }
+
+  if (e->recv == 0)
+    e->last_seqn = seqn - 1;
+  gap = SEQN_DIFF(seqn, e->last_seqn);
+  if (gap <= 0) // duplicate or resent packet
+    return;
+
+  e->lost += gap - 1;
+  e->recv++;
+  e->last_seqn = seqn;
+  e->hops = hops;
+  linkaddr_copy(&e->parent, &stats_conn->rx_parent);
+  e->latency = clock_time() - stats_conn->epoch_start;
+  e->last_epoch = stats_conn->beacon_seqn;
+  if (e->alerted)
+  {
+    printf("Stats: node %02x:%02x back\n", src->u8[0], src->u8[1]);
+    e->alerted = false;
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct sink_stats_entry *sink_stats_get(const linkaddr_t *src)
+{
+  return lookup(src, false);
+}
+/*---------------------------------------------------------------------------*/
+static void summary_cb(void *p)
+{
+  struct sink_stats_entry *e;
+  uint16_t epoch = stats_conn->beacon_seqn, missing;
+  uint16_t nodes = 0, alive = 0;
+  uint32_t recv = 0, lost = 0;
+  bool full = ++summary_cnt % SINK_STATS_SUMMARY_EPOCHS == 0;
+
+  ctimer_reset(&summary_timer);
+
+  for (e = table; e < table + MAX_NODES; e++)
+  {
+    if (linkaddr_cmp(&e->addr, &linkaddr_null))
+      continue;
+
+    nodes++;
+    recv += e->recv;
+    lost += e->lost;
+    missing = epoch - e->last_epoch;
+    if (missing == 0)
+      alive++;
+    else if (missing >= SINK_STATS_MISSING_EPOCHS && !e->alerted)
+    {
+      printf("Stats: ALERT node %02x:%02x missing for %u epochs\n",
+             e->addr.u8[0], e->addr.u8[1], missing);
+      e->alerted = true;
+    }
+
+    if (full)
+      printf("Stats: node %02x:%02x recv %u lost %u seqn %u hops %u parent %02x:%02x latency %lu ms epoch %u\n",
+             e->addr.u8[0], e->addr.u8[1], e->recv, e->lost, e->last_seqn, e->hops,
+             e->parent.u8[0], e->parent.u8[1],
+             (unsigned long)e->latency * 1000 / CLOCK_SECOND, e->last_epoch);
+  }
+
+  printf("Stats: epoch %u nodes %u heard %u recv %lu lost %lu\n",
+         epoch, nodes, alive, (unsigned long)recv, (unsigned long)lost);
+}
+/*---------------------------------------------------------------------------*/
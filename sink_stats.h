@@ -0,0 +1,40 @@
+#ifndef SINK_STATS_H
+#define SINK_STATS_H
+/*---------------------------------------------------------------------------*/
+#include "contiki.h"
+#include "core/net/linkaddr.h"
+#include "sched_collect.h"
+/*---------------------------------------------------------------------------*/
+#define SINK_STATS_SUMMARY_EPOCHS 10 // full per-node table every N epochs
+#define SINK_STATS_MISSING_EPOCHS 3  // alert when a node is silent for N epochs
+/*---------------------------------------------------------------------------*/
+/* Per-source health record kept at the sink */
+struct sink_stats_entry
+{
+  linkaddr_t addr;      // linkaddr_null for a free entry
+  linkaddr_t parent;    // parent reported in the last packet
+  uint16_t last_seqn;   // last application seqn
+  uint16_t recv;        // packets received
+  uint16_t lost;        // packets missing from the seqn sequence
+  uint16_t last_epoch;  // beacon seqn of the epoch the node was last heard
+  clock_time_t latency; // delivery time of the last packet from epoch start
+  uint8_t hops;
+  bool alerted;         // missing alert already issued
+};
+#define SINK_STATS_RAM (MAX_NODES * sizeof(struct sink_stats_entry)) // table of sink_stats.c
+/*---------------------------------------------------------------------------*/
+/* Start the statistics engine on the sink
+ *  - conn -- the sink connection, used to read the current epoch */
+void sink_stats_init(const struct sched_collect_conn *conn);
+/*---------------------------------------------------------------------------*/
+/* Account a packet delivered to the sink, to be called from the recv
+ * callback (the packet parent is read from conn->rx_parent)
+ *  - src  -- originator of the packet
+ *  - seqn -- application sequence number
+ *  - hops -- number of hops travelled */
+void sink_stats_update(const linkaddr_t *src, uint16_t seqn, uint8_t hops);
+/*---------------------------------------------------------------------------*/
+/* Look up the record of a source, NULL if it was never heard */
+const struct sink_stats_entry *sink_stats_get(const linkaddr_t *src);
+/*---------------------------------------------------------------------------*/
+#endif //SINK_STATS_H
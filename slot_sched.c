@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "slot_sched.h"
+#if SCHED_COLLECT_CONF_SLOT_REUSE
+/*---------------------------------------------------------------------------*/
+static uint8_t nbr[MAX_NODES][SLOT_SCHED_NBR_BYTES]; // reported neighbors, row id - 1 (0: sink)
+static uint8_t adj[MAX_NODES][SLOT_SCHED_NBR_BYTES]; // symmetric neighbor table
+static uint8_t reported[SLOT_SCHED_NBR_BYTES];       // nodes heard from in this period
+static uint8_t slot[MAX_NODES];
+static uint8_t changed[SLOT_SCHED_NBR_BYTES];        // slots not announced since they changed
+static uint8_t nslots;
+static bool pending; // a node without slot reported
+static uint8_t settling; // epochs left with a join slot per node
+typedef char slot_sched_ram_underestimated[sizeof(nbr) + sizeof(adj) + sizeof(reported) + sizeof(slot) + sizeof(changed) <= SLOT_SCHED_RAM ? 1 : -1];
+/*---------------------------------------------------------------------------*/
+/* A link counts if either end reported it */
+static void build_adj(void)
+{
+  uint16_t u, v;
+
+  memcpy(adj, nbr, sizeof(adj));
+  for (u = 1; u <= MAX_NODES; u++)
+    for (v = 1; v <= MAX_NODES; v++)
+      if (NBR_TEST(nbr[u - 1], v))
+        NBR_SET(adj[v - 1], u);
+}
+/*---------------------------------------------------------------------------*/
+/* Nodes within SLOT_SCHED_HOPS hops of u */
+static void conflicts(uint16_t u, uint8_t *set)
+{
+  uint8_t frontier[SLOT_SCHED_NBR_BYTES];
+  uint16_t w;
+  uint8_t h, i;
+
+  memcpy(set, adj[u - 1], SLOT_SCHED_NBR_BYTES);
+  for (h = 1; h < SLOT_SCHED_HOPS; h++)
+  {
+    memcpy(frontier, set, sizeof(frontier));
+    for (w = 1; w <= MAX_NODES; w++)
+      if (NBR_TEST(frontier, w))
+        for (i = 0; i < SLOT_SCHED_NBR_BYTES; i++)
+          set[i] |= adj[w - 1][i];
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Give node u slot s; the nodes sharing its old and new slot move up
+ * or down in the slot, all of them have to learn their new entry */
+static void set_slot(uint16_t u, uint8_t s)
+{
+  uint16_t v;
+
+  for (v = 2; v <= MAX_NODES; v++)
+    if (slot[v - 1] != SLOT_SCHED_NONE && (slot[v - 1] == slot[u - 1] || slot[v - 1] == s))
+      NBR_SET(changed, v);
+  NBR_SET(changed, u);
+  slot[u - 1] = s;
+}
+/*---------------------------------------------------------------------------*/
+void slot_sched_init(void)
+{
+  memset(nbr, 0, sizeof(nbr));
+  memset(reported, 0, sizeof(reported));
+  memset(slot, SLOT_SCHED_NONE, sizeof(slot));
+  memset(changed, 0, sizeof(changed));
+  nslots = 0;
+  pending = false;
+  settling = SLOT_SCHED_SETTLE;
+}
+/*---------------------------------------------------------------------------*/
+void slot_sched_report(uint8_t id, const uint8_t *nbrs)
+{
+  uint8_t i;
+
+  if (id < 2 || id > MAX_NODES)
+    return;
+  for (i = 0; i < SLOT_SCHED_NBR_BYTES; i++)
+    nbr[id - 1][i] |= nbrs[i];
+  NBR_SET(reported, id);
+  if (slot[id - 1] == SLOT_SCHED_NONE)
+    pending = true;
+}
+/*---------------------------------------------------------------------------*/
+void slot_sched_heard(uint8_t id)
+{
+  if (id >= 2 && id <= MAX_NODES)
+    NBR_SET(nbr[0], id);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t slot_sched_update(bool full)
+{
+  uint8_t set[SLOT_SCHED_NBR_BYTES], used[SLOT_SCHED_NBR_BYTES];
+  uint16_t u, v;
+  uint8_t share[MAX_NODES]; // nodes per slot
+  uint8_t s, assigned = 0;
+
+  if (settling > 0 && slot_sched_changed() == 0)
+    settling--;
+  if (!full && !pending)
+    return nslots;
+  build_adj();
+
+  /* Drop the nodes that are gone and, in id order, the slots that now
+   * conflict with a node already checked */
+  for (u = 2; full && u <= MAX_NODES; u++)
+  {
+    if (!NBR_TEST(reported, u))
+    {
+      if (slot[u - 1] != SLOT_SCHED_NONE)
+        set_slot(u, SLOT_SCHED_NONE);
+      continue;
+    }
+    conflicts(u, set);
+    for (v = 2; v < u && slot[u - 1] != SLOT_SCHED_NONE; v++)
+      if (NBR_TEST(set, v) && slot[v - 1] == slot[u - 1])
+      {
+        printf("Slots: node %u conflicts with %u in slot %u\n", u, v, slot[u - 1]);
+        set_slot(u, SLOT_SCHED_NONE);
+      }
+  }
+
+  /* Greedy coloring: lowest slot not used by a conflicting node */
+  for (u = 2; u <= MAX_NODES; u++)
+  {
+    if (!NBR_TEST(reported, u) || slot[u - 1] != SLOT_SCHED_NONE)
+      continue;
+    conflicts(u, set);
+    memset(used, 0, sizeof(used));
+    memset(share, 0, sizeof(share));
+    for (v = 2; v <= MAX_NODES; v++)
+      if (v != u && slot[v - 1] != SLOT_SCHED_NONE)
+      {
+        if (NBR_TEST(set, v) || ++share[slot[v - 1]] >= SLOT_SCHED_SHARE)
+          NBR_SET(used, slot[v - 1] + 1);
+      }
+    for (s = 0; NBR_TEST(used, s + 1); s++)
+      ;
+    set_slot(u, s);
+    settling = SLOT_SCHED_SETTLE;
+    printf("Slots: node %u slot %u\n", u, s);
+  }
+
+  nslots = 0;
+  for (u = 2; u <= MAX_NODES; u++)
+    if (slot[u - 1] != SLOT_SCHED_NONE)
+    {
+      assigned++;
+      if (slot[u - 1] >= nslots)
+        nslots = slot[u - 1] + 1;
+    }
+  printf("Slots: %u slots for %u nodes\n", nslots, assigned);
+
+  if (full)
+  {
+    memset(nbr, 0, sizeof(nbr));
+    memset(reported, 0, sizeof(reported));
+  }
+  pending = false;
+  return nslots;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t slot_sched_join_slots(void)
+{
+  return settling > 0 ? MAX_NODES - 1 : SLOT_SCHED_JOIN_SLOTS;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t slot_sched_changed(void)
+{
+  uint16_t u;
+
+  for (u = 2; u <= MAX_NODES; u++)
+    if (NBR_TEST(changed, u))
+      return u;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t slot_sched_get(uint8_t id)
+{
+  uint8_t v, rank = 0;
+
+  if (id < 2 || id > MAX_NODES)
+    return SLOT_SCHED_NONE;
+  NBR_CLEAR(changed, id);
+  if (slot[id - 1] == SLOT_SCHED_NONE)
+    return SLOT_SCHED_NONE;
+  for (v = 2; v < id; v++)
+    if (slot[v - 1] == slot[id - 1])
+      rank++;
+  return slot[id - 1] * SLOT_SCHED_SHARE + rank;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* SCHED_COLLECT_CONF_SLOT_REUSE */
@@ -0,0 +1,72 @@
+#ifndef SLOT_SCHED_H
+#define SLOT_SCHED_H
+/*---------------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+#include "sched_collect.h"
+/*---------------------------------------------------------------------------*/
+/* Sink-side slot scheduler for spatial slot reuse.
+ *
+ * Nodes report the ids of the neighbors they hear (a bitmap indexed by
+ * node id - 1, bit 0 is the sink) and the sink gives the same collection
+ * slot to nodes that are more than SLOT_SCHED_HOPS hops apart. With two,
+ * nodes sharing a slot are not neighbors and have no neighbor in common:
+ * their first transmissions can neither collide at a common receiver nor
+ * defer to each other. The number of slots then depends on the density
+ * of the network rather than on its size. Packets are relayed to the
+ * sink within the slot, so the paths of nodes sharing a slot still meet
+ * near the sink: SLOT_SCHED_SHARE bounds the nodes per slot, and they
+ * take turns in it.
+ *
+ * The neighbor table is rebuilt every SLOT_SCHED_PERIOD epochs so that
+ * links and nodes that are gone stop constraining the schedule. */
+#ifdef SLOT_SCHED_CONF_HOPS
+#define SLOT_SCHED_HOPS SLOT_SCHED_CONF_HOPS
+#else
+#define SLOT_SCHED_HOPS 2 // nodes up to this many hops apart never share a slot
+#endif
+#ifdef SLOT_SCHED_CONF_SHARE
+#define SLOT_SCHED_SHARE SLOT_SCHED_CONF_SHARE
+#else
+#define SLOT_SCHED_SHARE 2 // max nodes per slot, their packets still meet near the sink
+#endif
+#define SLOT_SCHED_NBR_BYTES ((MAX_NODES + 7) / 8)
+#define SLOT_SCHED_RAM ((2 * MAX_NODES + 2) * SLOT_SCHED_NBR_BYTES + MAX_NODES) // tables of slot_sched.c
+#define SLOT_SCHED_NONE 0xff // no slot assigned
+#define SLOT_SCHED_PERIOD 20 // epochs
+#define SLOT_SCHED_JOIN_SLOTS 4 // slots shared by the nodes without one, at the end of the window
+#define SLOT_SCHED_SETTLE 3 // epochs with a join slot per node id once the last new slot is announced
+#define NBR_SET(map, id) ((map)[((id) - 1) / 8] |= 1 << (((id) - 1) % 8))
+#define NBR_CLEAR(map, id) ((map)[((id) - 1) / 8] &= ~(1 << (((id) - 1) % 8)))
+#define NBR_TEST(map, id) ((map)[((id) - 1) / 8] & (1 << (((id) - 1) % 8)))
+/*---------------------------------------------------------------------------*/
+void slot_sched_init(void);
+/*---------------------------------------------------------------------------*/
+/* Record the neighbor bitmap reported by node id */
+void slot_sched_report(uint8_t id, const uint8_t *nbrs);
+/*---------------------------------------------------------------------------*/
+/* Record that the sink heard node id directly */
+void slot_sched_heard(uint8_t id);
+/*---------------------------------------------------------------------------*/
+/* Assign slots to the nodes that reported without having one; with full,
+ * check the whole schedule against the neighbor table and start a new
+ * table. Nodes keep their slot as long as it is conflict free.
+ * Returns the number of slots in use. */
+uint8_t slot_sched_update(bool full);
+/*---------------------------------------------------------------------------*/
+/* Join slots at the end of the window: SLOT_SCHED_JOIN_SLOTS shared ones
+ * once the schedule has settled, before that MAX_NODES - 1, one per node
+ * id, so that the nodes booting together do not collide until they all
+ * got a slot */
+uint8_t slot_sched_join_slots(void);
+/*---------------------------------------------------------------------------*/
+/* A node whose entry changed since slot_sched_get last returned it, 0 if
+ * none */
+uint8_t slot_sched_changed(void);
+/*---------------------------------------------------------------------------*/
+/* Entry of node id for the beacons, its slot * SLOT_SCHED_SHARE + its
+ * turn in the slot, SLOT_SCHED_NONE if not assigned. The entry counts as
+ * announced. */
+uint8_t slot_sched_get(uint8_t id);
+/*---------------------------------------------------------------------------*/
+#endif //SLOT_SCHED_H
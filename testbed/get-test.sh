@@ -1,6 +1,13 @@
 #!/usr/bin/bash
-TESTID=$1
-
-python "$TESTBED_CLIENT" download $1
-tar -xf 'job_'$TESTID'.tar.gz'
-rm 'job_'$TESTID'.tar.gz'
+# Download and untar testbed jobs: get-test.sh ID [ID...]
+# With TESTBED_ARCHIVE set, job_ID.tar.gz is taken from that directory
+# instead of the testbed client (e.g. a local copy of the jobs).
+for TESTID in "$@"; do
+	if [ -n "$TESTBED_ARCHIVE" ]; then
+		tar -xf "$TESTBED_ARCHIVE/job_$TESTID.tar.gz" || exit 1
+	else
+		python "$TESTBED_CLIENT" download $TESTID || exit 1
+		tar -xf 'job_'$TESTID'.tar.gz' || exit 1
+		rm 'job_'$TESTID'.tar.gz'
+	fi
+done
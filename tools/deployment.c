@@ -44,49 +44,12 @@
 unsigned short node_id = 0;
 #endif
 /*---------------------------------------------------------------------------*/
-/* List of ID <-> MAC mapping used for different deployments */
-static const id_mac_t id_mac_list[] = {
+/* ID <-> MAC mapping of the testbed, generated from deployment.csv and
+ * checked against MAX_NODES */
 #ifndef CONTIKI_TARGET_SKY
-  { 1,  {{0xf7, 0x9c}}},
-  { 2,  {{0xd9, 0x76}}},
-  { 3,  {{0xf3, 0x84}}},
-  { 4,  {{0xf3, 0xee}}},
-  { 5,  {{0xf7, 0x92}}},
-  { 6,  {{0xf3, 0x9a}}},
-  { 7,  {{0xde, 0x21}}},
-  { 8,  {{0xf2, 0xa1}}},
-  { 9,  {{0xd8, 0xb5}}},
-  {10,  {{0xf2, 0x1e}}},
-  {11,  {{0xd9, 0x5f}}},
-  {12,  {{0xf2, 0x33}}},
-  {13,  {{0xde, 0x0c}}},
-  {14,  {{0xf2, 0x0e}}},
-  {15,  {{0xd9, 0x49}}},
-  {16,  {{0xf3, 0xdc}}},
-  {17,  {{0xd9, 0x23}}},
-  {18,  {{0xf3, 0x8b}}},
-  {19,  {{0xf3, 0xc2}}},
-  {20,  {{0xf3, 0xb7}}},
-  {21,  {{0xde, 0xe4}}},
-  {22,  {{0xf3, 0x88}}},
-  {23,  {{0xf7, 0x9a}}},
-  {24,  {{0xf7, 0xe7}}},
-  {25,  {{0xf2, 0x85}}},
-  {26,  {{0xf2, 0x27}}},
-  {27,  {{0xf2, 0x64}}},
-  {28,  {{0xf3, 0xd3}}},
-  {29,  {{0xf3, 0x8d}}},
-  {30,  {{0xf7, 0xe1}}},
-  {31,  {{0xde, 0xaf}}},
-  {32,  {{0xf2, 0x91}}},
-  {33,  {{0xf2, 0xd7}}},
-  {34,  {{0xf3, 0xa3}}},
-  {35,  {{0xf2, 0xd9}}},
-  {36,  {{0xd9, 0x9f}}},
-#else
-  {0,   {{0x00, 0x00}}},
+#include "sched_collect.h"
+#include "deployment-table.h"
 #endif
-};
 /*---------------------------------------------------------------------------*/
 void
 deployment_set_node_id_from_lladdr(linkaddr_t *addr)
@@ -96,19 +59,26 @@ deployment_set_node_id_from_lladdr(linkaddr_t *addr)
    * Cooja directly assigns the node_id variable */
   return;
 #else 
-  /* Testbed experiment */
+  /* Testbed experiment: binary search of the table sorted by address,
+   * assuming network-wide unique 16-bit MAC addresses */
+  uint16_t lo = 0, hi = DEPLOYMENT_NODES, mid, key, curr;
+
+  node_id = 0;
   if(addr == NULL) {
-    node_id = 0;
-  } else {
-    const id_mac_t *curr = id_mac_list;
-    while(curr->id != 0) {
-      /* Assume network-wide unique 16-bit MAC addresses */
-      if(curr->mac.u8[0] == addr->u8[0] && curr->mac.u8[1] == addr->u8[1]) {
-        node_id = curr->id;
-        printf("Deployment: node_id %d\n", node_id);
-        return;
-      }
-      curr++;
+    return;
+  }
+  key = (uint16_t)addr->u8[0] << 8 | addr->u8[1];
+  while(lo < hi) {
+    mid = (lo + hi) / 2;
+    curr = (uint16_t)deployment_table[mid].mac.u8[0] << 8 | deployment_table[mid].mac.u8[1];
+    if(curr == key) {
+      node_id = deployment_table[mid].id;
+      printf("Deployment: node_id %d\n", node_id);
+      return;
+    } else if(curr < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
     }
   }
 #endif
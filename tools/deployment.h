@@ -42,7 +42,7 @@
 /*---------------------------------------------------------------------------*/
 /* ID <-> MAC address mapping */
 typedef struct id_mac {
-  uint8_t id;
+  uint16_t id;
   linkaddr_t mac;
 } id_mac_t;
 /*---------------------------------------------------------------------------*/
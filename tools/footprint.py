@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# RAM and ROM footprint of the firmware, per module and per symbol.
+#
+#   make footprint                  app.sky, MSP430 binutils
+#   make TARGET=zoul footprint      Firefly, ARM binutils
+#
+# ROM is .text + .data (initial values), RAM is .data + .bss of each object
+# file; the project modules (the collect stack and the application) are
+# listed one by one, the Contiki objects as a whole. The largest RAM
+# symbols of the final ELF come last. Static RAM only: the stacks of the
+# processes and the heap are not counted.
+
+import os
+import sys
+import argparse
+import subprocess
+
+
+def size(tool, files):
+	"""Return {file: (text, data, bss)} from the Berkeley format of size"""
+	out = subprocess.check_output([tool] + files).decode()
+	sizes = {}
+	for line in out.splitlines()[1:]:
+		cols = line.split()
+		if len(cols) >= 6:
+			sizes[cols[5]] = (int(cols[0]), int(cols[1]), int(cols[2]))
+	return sizes
+
+
+def ram_symbols(tool, elf, count):
+	"""Return the count largest (size, name) of .data and .bss"""
+	out = subprocess.check_output([tool, '-S', '--size-sort', '-t', 'd', elf]).decode()
+	syms = []
+	for line in out.splitlines():
+		cols = line.split()
+		if len(cols) == 4 and cols[2] in 'bBdD':
+			syms.append((int(cols[1]), cols[3]))
+	return sorted(syms, reverse=True)[:count]
+
+
+def main():
+	parser = argparse.ArgumentParser()
+	parser.add_argument('elf', help="firmware, e.g. app.sky")
+	parser.add_argument('objects', nargs='*', help="object files of the build")
+	parser.add_argument('--tools', default='', help="binutils prefix, e.g. msp430-")
+	parser.add_argument('--project', default='',
+		help="object files of the project modules (space separated)")
+	parser.add_argument('--ram', type=int, help="RAM of the platform in bytes")
+	parser.add_argument('--rom', type=int, help="ROM of the platform in bytes")
+	parser.add_argument('--symbols', type=int, default=15, help="RAM symbols to list")
+	args = parser.parse_args()
+
+	objects = [o for o in args.objects if os.path.exists(o)]
+	project = set(args.project.split())
+	sizes = size(args.tools + 'size', [args.elf] + objects)
+	text, data, bss = sizes.pop(args.elf)
+
+	print("{:<24} {:>8} {:>8}".format("module", "ROM", "RAM"))
+	other = [0, 0]
+	for obj, (t, d, b) in sorted(sizes.items(), key=lambda s: -(s[1][1] + s[1][2])):
+		if os.path.basename(obj) in project:
+			print("{:<24} {:>8} {:>8}".format(os.path.basename(obj), t + d, d + b))
+		else:
+			other[0] += t + d
+			other[1] += d + b
+	if objects:
+		print("{:<24} {:>8} {:>8}".format("contiki (other objects)", other[0], other[1]))
+	line = "{:<24} {:>8} {:>8}".format(os.path.basename(args.elf), text + data, data + bss)
+	if args.rom and args.ram:
+		line += "   ({:.1f}% of ROM, {:.1f}% of RAM)".format(
+			100.0 * (text + data) / args.rom, 100.0 * (data + bss) / args.ram)
+	print(line)
+
+	print("\n{:>8}  {}".format("RAM", "largest symbols"))
+	for n, name in ram_symbols(args.tools + 'nm', args.elf, args.symbols):
+		print("{:>8}  {}".format(n, name))
+
+	if args.ram and data + bss > args.ram:
+		sys.exit("footprint: static RAM {} over {} bytes".format(data + bss, args.ram))
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# Generate the firmware ID <-> address table from the deployment description
+# (tools/deployment.csv): the entries are sorted by address for the binary
+# search of deployment_set_node_id_from_lladdr().
+#
+#   python3 tools/gen-deployment.py tools/deployment.csv -o tools/deployment-table.h
+
+import sys
+import argparse
+
+
+def load_deployment(fname):
+	"""Return the list of (id, (byte0, byte1)) of the deployment, checked for
+	duplicate ids and addresses."""
+	nodes = []
+	ids = {}
+	addrs = {}
+	with open(fname, 'r') as f:
+		for lineno, line in enumerate(f, 1):
+			line = line.split('#', 1)[0].strip()
+			if not line or line == "id,addr":
+				continue
+			try:
+				node_id, addr = line.split(',')
+				node_id = int(node_id)
+				addr = tuple(int(b, 16) for b in addr.strip().split(':'))
+			except ValueError:
+				sys.exit("{}:{}: expected id,xx:xx".format(fname, lineno))
+			if len(addr) != 2 or not all(0 <= b <= 0xff for b in addr):
+				sys.exit("{}:{}: address must be 2 bytes".format(fname, lineno))
+			if not 0 < node_id < 0x10000:
+				sys.exit("{}:{}: id {} out of range".format(fname, lineno, node_id))
+			if node_id in ids:
+				sys.exit("{}:{}: id {} already on line {}".format(
+					fname, lineno, node_id, ids[node_id]))
+			if addr in addrs:
+				sys.exit("{}:{}: address {:02x}:{:02x} already on line {}".format(
+					fname, lineno, addr[0], addr[1], addrs[addr]))
+			ids[node_id] = lineno
+			addrs[addr] = lineno
+			nodes.append((node_id, addr))
+	return nodes
+
+
+def main():
+	parser = argparse.ArgumentParser()
+	parser.add_argument('deployment', help="deployment description (id,addr lines)")
+	parser.add_argument('-o', '--output', help="header to write (default stdout)")
+	args = parser.parse_args()
+
+	# Nothing is written unless the description is valid
+	nodes = sorted(load_deployment(args.deployment), key=lambda n: n[1])
+	if not nodes:
+		sys.exit("{}: no nodes".format(args.deployment))
+	out = open(args.output, 'w') if args.output else sys.stdout
+	out.write("/* Generated by tools/gen-deployment.py from {}, do not edit */\n".format(
+		args.deployment))
+	out.write("#define DEPLOYMENT_NODES {}\n".format(len(nodes)))
+	out.write("#define DEPLOYMENT_MAX_ID {}\n".format(max(n[0] for n in nodes)))
+	out.write("/* Node ids index the collection slots of sched_collect */\n")
+	out.write("#if DEPLOYMENT_MAX_ID > MAX_NODES\n")
+	out.write("#error \"{}: node ids beyond MAX_NODES\"\n".format(args.deployment))
+	out.write("#endif\n")
+	out.write("/* Sorted by address */\n")
+	out.write("static const id_mac_t deployment_table[] = {\n")
+	for node_id, addr in nodes:
+		out.write("  {{{:3d}, {{{{0x{:02x}, 0x{:02x}}}}}}},\n".format(node_id, addr[0], addr[1]))
+	out.write("};\n")
+	if args.output:
+		out.close()
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Regression test of parse-stats.py on short testbed and Cooja logs in the
+# format of the current firmware (app.c). Run by make -C sim check.
+#
+#   python3 tools/test-parse-stats.py
+
+import os
+import shutil
+import tempfile
+import unittest
+import contextlib
+import importlib.util
+import pandas as pd
+
+repo = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+spec = importlib.util.spec_from_file_location("parse_stats",
+	os.path.join(repo, "parse-stats.py"))
+parse_stats = importlib.util.module_from_spec(spec)
+spec.loader.exec_module(parse_stats)
+
+
+def testbed_line(sec, node, msg):
+	return "[2021-04-06 13:01:{:02d},{:03d}] INFO:firefly.{}: {}.firefly < b'{}'\n".format(
+		sec // 1000, sec % 1000, node, node, msg)
+
+
+def cooja_line(ms, node, msg):
+	return "{}\tID:{}\t{}\n".format(ms * 1000, node, msg)
+
+
+class ParseStatsTest(unittest.TestCase):
+
+	def setUp(self):
+		self.dir = tempfile.mkdtemp()
+
+	def tearDown(self):
+		shutil.rmtree(self.dir)
+
+	def parse(self, lines, testbed):
+		log_file = os.path.join(self.dir, "test.log")
+		with open(log_file, 'w') as f:
+			f.writelines(lines)
+		with open(os.devnull, 'w') as null, contextlib.redirect_stdout(null):
+			summary = parse_stats.parse_file(log_file, testbed=testbed)
+		return summary, pd.read_csv(os.path.join(self.dir, "test-sent.csv"), sep='\t')
+
+	def log(self, line, sink_addr):
+		# Node 2 sends seqn 0..3 (the first and last one do not count for the
+		# PDR), 2 is lost; the seqn 1 line is in the format before samples and
+		# a resend of seqn 0 is refused
+		lines = [line(0, 1, "App: I am sink {} with node_id 1".format(sink_addr))]
+		for seqn in range(4):
+			t = 1000 + seqn * 1000
+			if seqn == 1:
+				lines.append(line(t, 2, "App: Send seqn 1"))
+			else:
+				lines.append(line(t, 2, "App: Send seqn {} samples 4 len 9".format(seqn)))
+			if seqn != 2:
+				lines.append(line(t + 200, 1, "App: Recv from {} seqn {} hops 1".format(
+					self.node2, seqn)))
+		lines.append(line(3500, 2, "App: cannot resend seqn 0"))
+		for cnt in range(2, 5):
+			for node in (1, 2):
+				lines.append(line(cnt * 1000 + 500, node, "Energest: {} 100 900 10 90".format(cnt)))
+		return lines
+
+	def test_testbed(self):
+		self.node2 = "d9:76" # firefly.2 in tools/deployment.csv
+		summary, sent = self.parse(self.log(testbed_line, "f7:9c"), True)
+		self.assertEqual(list(sent.seqn), [0, 1, 2, 3])
+		self.assertTrue((sent.src == 2).all())
+		self.assertEqual((summary['sent'], summary['recv']), (2, 1))
+		self.assertAlmostEqual(summary['dc_avg'], 10.0)
+		self.assertEqual(summary['resend_refused'], 1)
+
+	def test_cooja(self):
+		self.node2 = "02:00"
+		summary, sent = self.parse(self.log(cooja_line, "01:00"), False)
+		self.assertEqual(list(sent.seqn), [0, 1, 2, 3])
+		self.assertEqual((summary['sent'], summary['recv']), (2, 1))
+		self.assertEqual(summary['resend_refused'], 1)
+
+
+if __name__ == '__main__':
+	unittest.main()